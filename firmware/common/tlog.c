@@ -0,0 +1,67 @@
+/**
+ * \file
+ *         Tokenised logging, see tlog.h for the record format.
+ */
+
+#include "tlog.h"
+
+#if TLOG_ENABLED
+static const char hex[] = "0123456789abcdef";
+/*---------------------------------------------------------------------------*/
+static void
+write_byte(uint8_t b)
+{
+  putchar(hex[b >> 4]);
+  putchar(hex[b & 0xf]);
+}
+/*---------------------------------------------------------------------------*/
+void
+tlog_put(struct tlog_rec *rec, uint8_t type, uint32_t value)
+{
+  uint8_t size = type == TLOG_ARG_LONG ? 4 : 2;
+
+  if(rec->full || rec->len + 1 + size > TLOG_BUF_SIZE) {
+    /* Drop this and every later argument so that the order holds */
+    rec->full = 1;
+    return;
+  }
+  rec->buf[rec->len++] = type;
+  for(; size > 0; --size) {
+    rec->buf[rec->len++] = value & 0xff;
+    value >>= 8;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tlog_put_str(struct tlog_rec *rec, const char *s)
+{
+  if(rec->full || rec->len + 2 > TLOG_BUF_SIZE) {
+    rec->full = 1;
+    return;
+  }
+  rec->buf[rec->len++] = TLOG_ARG_STR;
+  for(; *s != '\0' && rec->len < TLOG_BUF_SIZE - 1; ++s) {
+    rec->buf[rec->len++] = *s;
+  }
+  rec->buf[rec->len++] = '\0';
+}
+/*---------------------------------------------------------------------------*/
+void
+tlog_write(const char *fmt, const struct tlog_rec *rec)
+{
+  uint16_t token = (uint16_t)(uintptr_t)fmt;
+  const char *m;
+  uint8_t i;
+
+  for(m = TLOG_MARKER; *m != '\0'; ++m) {
+    putchar(*m);
+  }
+  write_byte(token & 0xff);
+  write_byte(token >> 8);
+  for(i = 0; i < rec->len; ++i) {
+    write_byte(rec->buf[i]);
+  }
+  putchar('\n');
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TLOG_ENABLED */
@@ -0,0 +1,106 @@
+/**
+ * \file
+ *         Tokenised logging.
+ *
+ *         TLOG() takes a printf() format string and its arguments, but
+ *         instead of formatting them on the mote it writes a record
+ *         holding the address of the format string and the raw
+ *         argument values. The format strings are placed in their own
+ *         ELF section, .tlog, which is never read at run time and can
+ *         be stripped from the flashed image with
+ *
+ *           msp430-objcopy -R .tlog firmware.sky firmware-stripped.sky
+ *
+ *         tools/tlog-decode.py re-renders the original text from the
+ *         records using the .tlog section of the unstripped ELF file.
+ *
+ *         Every argument is wrapped to give its type, which must match
+ *         its conversion in the format string:
+ *
+ *           TLOG_I(x)  %d, %u, %x, %c   16 bits
+ *           TLOG_L(x)  %ld, %lu, %lx    32 bits
+ *           TLOG_S(s)  %s               NUL-terminated string
+ *
+ *         The wrappers append a type tag and the value to a
+ *         TLOG_BUF_SIZE byte buffer on the stack: an int takes 3
+ *         bytes, a long 5 and a string its length plus 2. Strings that
+ *         do not fit are truncated and later arguments are dropped.
+ *
+ *         Record format: TLOG_MARKER followed by the 16-bit token and
+ *         the buffer (little endian) as lower-case hex, terminated by a
+ *         newline. Records are plain text, so they survive the Cooja
+ *         mote output log and serial consoles unchanged.
+ *
+ *         With TLOG_CONF_ENABLED set to 0, TLOG() is a plain printf().
+ */
+
+#ifndef TLOG_H_
+#define TLOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef TLOG_CONF_ENABLED
+#define TLOG_ENABLED TLOG_CONF_ENABLED
+#else
+#define TLOG_ENABLED 1
+#endif
+
+#ifdef TLOG_CONF_BUF_SIZE
+#define TLOG_BUF_SIZE TLOG_CONF_BUF_SIZE
+#else
+#define TLOG_BUF_SIZE 32
+#endif
+
+#define TLOG_MARKER "tlog:"
+
+#if TLOG_ENABLED
+
+enum {
+  TLOG_ARG_NONE,
+  TLOG_ARG_INT,
+  TLOG_ARG_LONG,
+  TLOG_ARG_STR,
+};
+
+struct tlog_rec {
+  uint8_t len;
+  uint8_t full;
+  uint8_t buf[TLOG_BUF_SIZE];
+};
+
+#define TLOG_I(x) tlog_put(&tlog_rec, TLOG_ARG_INT, (uint16_t)(x))
+#define TLOG_L(x) tlog_put(&tlog_rec, TLOG_ARG_LONG, (uint32_t)(x))
+#define TLOG_S(s) tlog_put_str(&tlog_rec, (const char *)(s))
+
+/* The wrapped arguments are evaluated left to right by the comma
+   operator, each appending to tlog_rec */
+#define TLOG(fmt, ...) do {                                             \
+    static const char tlog_fmt[]                                        \
+      __attribute__((section(".tlog"), used)) = fmt;                    \
+    struct tlog_rec tlog_rec;                                           \
+    tlog_rec.len = tlog_rec.full = 0;                                   \
+    (void)0, ##__VA_ARGS__;                                             \
+    tlog_write(tlog_fmt, &tlog_rec);                                    \
+  } while(0)
+
+/* Append an int or long argument to a record, called by TLOG_I/TLOG_L */
+void tlog_put(struct tlog_rec *rec, uint8_t type, uint32_t value);
+
+/* Append a string argument to a record, called by TLOG_S */
+void tlog_put_str(struct tlog_rec *rec, const char *s);
+
+/* Write one record, called by TLOG() */
+void tlog_write(const char *fmt, const struct tlog_rec *rec);
+
+#else /* TLOG_ENABLED */
+
+#define TLOG_I(x) ((int)(x))
+#define TLOG_L(x) ((unsigned long)(x))
+#define TLOG_S(s) ((const char *)(s))
+
+#define TLOG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+
+#endif /* TLOG_ENABLED */
+
+#endif /* TLOG_H_ */
@@ -0,0 +1,312 @@
+/**
+ * \file
+ *         In-network coverage collection, see tpwsn-collect.h.
+ */
+
+#include "tpwsn-collect.h"
+#include "tpwsn.h"
+
+#include "lib/random.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Hop count of a node without a route to the sink, and the longest
+   route accepted, which bounds counting to infinity after failures */
+#define HOPS_UNKNOWN 0xff
+#define MAX_HOPS 32
+
+/* Nodes are identified in the summaries by the low byte of node_id,
+   which is set on both stacks (the link address is not on Contiki-NG).
+   0 marks an unused entry, so node IDs must not be multiples of 256 */
+#define SELF_ID ((uint8_t)(node_id & 0xff))
+
+/* Periods after which a silent parent or child is forgotten */
+#define TIMEOUT_PERIODS 3
+
+#ifdef TPWSN_COLLECT_CONF_MAX_CHILDREN
+#define MAX_CHILDREN TPWSN_COLLECT_CONF_MAX_CHILDREN
+#else
+#define MAX_CHILDREN 8
+#endif
+
+/*
+ * counts[i] is the number of nodes in the subtree holding version
+ * newest - i, the last bin also holds the nodes with older versions
+ * and those that have not received anything.
+ */
+struct summary {
+  uint8_t id;
+  uint8_t hops;
+  uint8_t parent;
+  uint8_t reserved;
+  uint16_t newest;
+  uint16_t counts[TPWSN_COLLECT_BINS];
+};
+
+struct child {
+  uint8_t id;
+  uint8_t age;
+  struct summary summary;
+};
+
+static tpwsn_collect_send_t send_summary;
+static uint16_t period = 0;
+static struct ctimer timer;
+
+static uint8_t parent = 0;
+static uint8_t parent_hops = HOPS_UNKNOWN;
+static uint8_t parent_age = 0;
+static struct child children[MAX_CHILDREN];
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hops(void)
+{
+  if(tpwsn_is_sink()) {
+    return 0;
+  }
+  if(parent == 0) {
+    return HOPS_UNKNOWN;
+  }
+  return parent_hops + 1;
+}
+/*---------------------------------------------------------------------------*/
+static bool
+newer(uint16_t a, uint16_t b)
+{
+  return a != 0 && (b == 0 || (int16_t)(a - b) > 0);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Add the counts of a subtree to an aggregate whose newest version is
+ * at least as new, moving them down by the difference between the two.
+ */
+static void
+merge(struct summary *agg, const struct summary *s)
+{
+  uint16_t shift = agg->newest - s->newest;
+  uint8_t i, bin;
+
+  for(i = 0; i < TPWSN_COLLECT_BINS; ++i) {
+    if(s->newest == 0 || i + shift >= TPWSN_COLLECT_BINS - 1) {
+      bin = TPWSN_COLLECT_BINS - 1;
+    } else {
+      bin = i + shift;
+    }
+    agg->counts[bin] += s->counts[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Build the summary of this node's subtree from its own coverage state
+ * and the latest summaries of its children.
+ */
+static void
+aggregate(struct summary *agg)
+{
+  struct summary own;
+  uint8_t i;
+
+  memset(&own, 0, sizeof(own));
+  own.newest = tpwsn_coverage_state();
+  own.counts[own.newest == 0 ? TPWSN_COLLECT_BINS - 1 : 0] = 1;
+
+  memset(agg, 0, sizeof(*agg));
+  agg->id = SELF_ID;
+  agg->hops = hops();
+  agg->parent = tpwsn_is_sink() ? 0 : parent;
+  agg->newest = own.newest;
+  for(i = 0; i < MAX_CHILDREN; ++i) {
+    if(children[i].id != 0 && newer(children[i].summary.newest, agg->newest)) {
+      agg->newest = children[i].summary.newest;
+    }
+  }
+
+  merge(agg, &own);
+  for(i = 0; i < MAX_CHILDREN; ++i) {
+    if(children[i].id != 0) {
+      merge(agg, &children[i].summary);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_coverage(const struct summary *agg)
+{
+  uint16_t nodes = 0;
+  uint8_t i;
+
+  for(i = 0; i < TPWSN_COLLECT_BINS; ++i) {
+    nodes += agg->counts[i];
+  }
+
+  printf("%d.%d: collect at %lu newest %u nodes %u counts",
+         TPWSN_NODE,
+         (unsigned long) clock_time(), agg->newest, nodes);
+  for(i = 0; i < TPWSN_COLLECT_BINS; ++i) {
+    printf(" %u", agg->counts[i]);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_timer(void);
+
+static void
+report(void *ptr)
+{
+  struct summary agg;
+  uint8_t i;
+
+  // Forget parents and children that have gone silent
+  if(parent != 0 && ++parent_age > TIMEOUT_PERIODS) {
+    parent = 0;
+    parent_hops = HOPS_UNKNOWN;
+  }
+  for(i = 0; i < MAX_CHILDREN; ++i) {
+    if(children[i].id != 0 && ++children[i].age > TIMEOUT_PERIODS) {
+      children[i].id = 0;
+    }
+  }
+
+  aggregate(&agg);
+  if(tpwsn_is_sink()) {
+    print_coverage(&agg);
+  }
+  if(send_summary != NULL) {
+    send_summary(&agg, sizeof(agg));
+  }
+
+  set_timer();
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_timer(void)
+{
+  clock_time_t interval = (clock_time_t)period * CLOCK_SECOND;
+
+  // Jitter each report by a quarter of the period either way so that
+  // neighbours do not stay synchronised
+  ctimer_set(&timer, interval - interval / 4 + random_rand() % (interval / 2 + 1),
+             report, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_child(uint8_t id, const struct summary *s)
+{
+  struct child *c = NULL;
+  struct child *victim = &children[0];
+  uint8_t i;
+
+  for(i = 0; i < MAX_CHILDREN && c == NULL; ++i) {
+    if(children[i].id == id) {
+      c = &children[i];
+    } else if(children[i].id == 0) {
+      // Prefer a free entry over the one heard from least recently
+      if(victim->id != 0) {
+        victim = &children[i];
+      }
+    } else if(victim->id != 0 && children[i].age > victim->age) {
+      victim = &children[i];
+    }
+  }
+  if(c == NULL) {
+    c = victim;
+  }
+
+  c->id = id;
+  c->age = 0;
+  memcpy(&c->summary, s, sizeof(*s));
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_child(uint8_t id)
+{
+  uint8_t i;
+
+  for(i = 0; i < MAX_CHILDREN; ++i) {
+    if(children[i].id == id) {
+      children[i].id = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_collect_open(tpwsn_collect_send_t send)
+{
+  send_summary = send;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_collect_input(const void *data, uint16_t len)
+{
+  struct summary s;
+  uint8_t me = SELF_ID;
+
+  if(!tpwsn_is_up() || period == 0 || len != sizeof(s)) {
+    return;
+  }
+  memcpy(&s, data, sizeof(s));
+  if(s.id == 0 || s.id == me) {
+    return;
+  }
+
+  // Children are the neighbours that have picked us as their parent
+  if(s.parent == me) {
+    update_child(s.id, &s);
+  } else {
+    remove_child(s.id);
+  }
+
+  if(tpwsn_is_sink()) {
+    return;
+  }
+
+  // Follow the parent's hop count, and switch to any neighbour that is
+  // closer to the sink and not routing through us
+  if(s.id == parent) {
+    if(s.hops >= MAX_HOPS || s.parent == me) {
+      parent = 0;
+      parent_hops = HOPS_UNKNOWN;
+    } else {
+      parent_hops = s.hops;
+      parent_age = 0;
+    }
+  } else if(s.hops < MAX_HOPS && s.parent != me &&
+            (parent == 0 || s.hops < parent_hops)) {
+    parent = s.id;
+    parent_hops = s.hops;
+    parent_age = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_collect_set_period(uint16_t seconds)
+{
+  period = seconds;
+  printf("Setting collection period to %u\n", period);
+
+  tpwsn_collect_stop();
+  if(tpwsn_is_up()) {
+    tpwsn_collect_start();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_collect_stop(void)
+{
+  ctimer_stop(&timer);
+  parent = 0;
+  parent_hops = HOPS_UNKNOWN;
+  memset(children, 0, sizeof(children));
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_collect_start(void)
+{
+  if(period > 0) {
+    set_timer();
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,53 @@
+/**
+ * \file
+ *         In-network coverage collection.
+ *
+ *         Every node periodically broadcasts a summary of the coverage
+ *         state of its subtree: the number of nodes holding each of the
+ *         newest TPWSN_COLLECT_BINS - 1 versions, and the number holding
+ *         anything older (or nothing). Nodes pick the neighbour with the
+ *         fewest hops to the sink as their parent and add the latest
+ *         summaries of their children to their own state, so the sink
+ *         can print the coverage of the whole network without scraping
+ *         every node over serial.
+ *
+ *         The protocol firmware supplies the link-local broadcast used
+ *         for the summaries with tpwsn_collect_open() and passes every
+ *         summary it receives to tpwsn_collect_input(). Collection is
+ *         off until the period is set over serial with
+ *
+ *           collect <seconds>
+ *
+ *         and "collect 0" turns it off again. The root of the tree is
+ *         the node set with "set sink".
+ */
+
+#ifndef TPWSN_COLLECT_H_
+#define TPWSN_COLLECT_H_
+
+#include <stdint.h>
+
+#ifdef TPWSN_COLLECT_CONF_BINS
+#define TPWSN_COLLECT_BINS TPWSN_COLLECT_CONF_BINS
+#else
+#define TPWSN_COLLECT_BINS 4
+#endif
+
+/* Broadcast a summary to all neighbours */
+typedef void (* tpwsn_collect_send_t)(const void *data, uint16_t len);
+
+/* Register the transport of the protocol firmware */
+void tpwsn_collect_open(tpwsn_collect_send_t send);
+
+/* Hand a received summary to the collection tree */
+void tpwsn_collect_input(const void *data, uint16_t len);
+
+/* Set the reporting period in seconds, 0 turns collection off */
+void tpwsn_collect_set_period(uint16_t period);
+
+/* Stop and forget the tree when the node loses power, and rejoin it
+   when power returns */
+void tpwsn_collect_stop(void);
+void tpwsn_collect_start(void);
+
+#endif /* TPWSN_COLLECT_H_ */
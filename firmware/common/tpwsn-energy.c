@@ -0,0 +1,77 @@
+/**
+ * \file
+ *         Current-draw table of the Tmote Sky, see tpwsn-energy.h.
+ */
+
+#include "tpwsn-energy.h"
+#include "tpwsn.h"
+
+#include "sys/energest.h"
+
+#include <stdio.h>
+
+/* CC2420 transmit current in uA at PA levels 3, 7, ..., 31 */
+static const uint16_t tx_currents[] = {
+  8500, 9900, 11200, 12500, 13900, 15200, 16500, 17400
+};
+/*---------------------------------------------------------------------------*/
+uint16_t
+tpwsn_energy_tx_current(uint8_t level)
+{
+  // Levels between the datasheet points draw as much as the next one up
+  if(level > 31) {
+    level = 31;
+  }
+  return tx_currents[level / 4];
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+tpwsn_energy_current(uint8_t type)
+{
+  switch(type) {
+  case ENERGEST_TYPE_CPU:
+    return TPWSN_ENERGY_CPU;
+  case ENERGEST_TYPE_LPM:
+    return TPWSN_ENERGY_LPM;
+  case ENERGEST_TYPE_TRANSMIT:
+    return tpwsn_energy_tx_current(TPWSN_ENERGY_TX_LEVEL);
+  case ENERGEST_TYPE_LISTEN:
+    return TPWSN_ENERGY_LISTEN;
+  default:
+    return 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+tpwsn_energy_uj(uint8_t type, unsigned long ticks, uint16_t mv)
+{
+  // uA * mV is nW
+  return (uint64_t)ticks * tpwsn_energy_current(type) * mv /
+    ENERGEST_SECOND / 1000;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_energy_stats(void)
+{
+  uint32_t cpu, lpm, tx, rx;
+
+  energest_flush();
+  cpu = tpwsn_energy_uj(ENERGEST_TYPE_CPU,
+                        energest_type_time(ENERGEST_TYPE_CPU),
+                        TPWSN_ENERGY_VOLTAGE);
+  lpm = tpwsn_energy_uj(ENERGEST_TYPE_LPM,
+                        energest_type_time(ENERGEST_TYPE_LPM),
+                        TPWSN_ENERGY_VOLTAGE);
+  tx = tpwsn_energy_uj(ENERGEST_TYPE_TRANSMIT,
+                       energest_type_time(ENERGEST_TYPE_TRANSMIT),
+                       TPWSN_ENERGY_VOLTAGE);
+  rx = tpwsn_energy_uj(ENERGEST_TYPE_LISTEN,
+                       energest_type_time(ENERGEST_TYPE_LISTEN),
+                       TPWSN_ENERGY_VOLTAGE);
+
+  printf("%d.%d: energy uJ cpu %lu lpm %lu tx %lu rx %lu total %lu\n",
+         TPWSN_NODE,
+         (unsigned long)cpu, (unsigned long)lpm, (unsigned long)tx,
+         (unsigned long)rx, (unsigned long)(cpu + lpm + tx + rx));
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,82 @@
+/**
+ * \file
+ *         Current-draw table of the Tmote Sky used to turn Energest times
+ *         into energy.
+ *
+ *         The currents are per component in uA at TPWSN_ENERGY_VOLTAGE,
+ *         from the MSP430F1611 and CC2420 datasheets. Energest counts the
+ *         CPU and the radio separately, so the radio currents do not
+ *         include the MCU. Each value can be overridden from
+ *         project-conf.h to calibrate the model against another board.
+ *         tools/energy-model.py applies the same table, or one given in
+ *         a JSON file, to the Energest lines of a log.
+ */
+
+#ifndef TPWSN_ENERGY_H_
+#define TPWSN_ENERGY_H_
+
+#include "contiki.h"
+#include "sys/energest.h"
+
+#include <stdint.h>
+
+/* Contiki 3 counts Energest time in rtimer ticks */
+#ifndef ENERGEST_SECOND
+#define ENERGEST_SECOND RTIMER_SECOND
+#endif
+
+/* Supply voltage in mV */
+#ifdef TPWSN_ENERGY_CONF_VOLTAGE
+#define TPWSN_ENERGY_VOLTAGE TPWSN_ENERGY_CONF_VOLTAGE
+#else
+#define TPWSN_ENERGY_VOLTAGE 3000
+#endif
+
+/* MSP430 active at 3.9 MHz */
+#ifdef TPWSN_ENERGY_CONF_CPU
+#define TPWSN_ENERGY_CPU TPWSN_ENERGY_CONF_CPU
+#else
+#define TPWSN_ENERGY_CPU 1800
+#endif
+
+/* MSP430 in LPM3, with the radio voltage regulator on */
+#ifdef TPWSN_ENERGY_CONF_LPM
+#define TPWSN_ENERGY_LPM TPWSN_ENERGY_CONF_LPM
+#else
+#define TPWSN_ENERGY_LPM 55
+#endif
+
+/* CC2420 receiving or listening */
+#ifdef TPWSN_ENERGY_CONF_LISTEN
+#define TPWSN_ENERGY_LISTEN TPWSN_ENERGY_CONF_LISTEN
+#else
+#define TPWSN_ENERGY_LISTEN 18800
+#endif
+
+/* CC2420 PA level (0-31) the firmware transmits at */
+#ifdef TPWSN_ENERGY_CONF_TX_LEVEL
+#define TPWSN_ENERGY_TX_LEVEL TPWSN_ENERGY_CONF_TX_LEVEL
+#elif defined(CC2420_CONF_TXPOWER)
+#define TPWSN_ENERGY_TX_LEVEL CC2420_CONF_TXPOWER
+#else
+#define TPWSN_ENERGY_TX_LEVEL 31
+#endif
+
+/* M25P80 external flash page program and read. The firmwares do not
+   use the flash, the values are kept for the analysis tools */
+#define TPWSN_ENERGY_FLASH_WRITE 15000
+#define TPWSN_ENERGY_FLASH_READ  4000
+
+/* CC2420 transmit current at a PA level */
+uint16_t tpwsn_energy_tx_current(uint8_t level);
+
+/* Supply current of an Energest type */
+uint16_t tpwsn_energy_current(uint8_t type);
+
+/* Energy in uJ drawn over Energest ticks of a type at a voltage in mV */
+uint32_t tpwsn_energy_uj(uint8_t type, unsigned long ticks, uint16_t mv);
+
+/* Print the energy spent by the node so far */
+void tpwsn_energy_stats(void);
+
+#endif /* TPWSN_ENERGY_H_ */
@@ -0,0 +1,220 @@
+/**
+ * \file
+ *         Energy-neutral duty-cycle controller, see tpwsn-eno.h.
+ */
+
+#include "tpwsn-eno.h"
+#include "tpwsn.h"
+#include "tpwsn-energy.h"
+#include "tpwsn-mac.h"
+#include "tpwsn-wur.h"
+
+#include "net/netstack.h"
+#include "sys/energest.h"
+
+#include <stdio.h>
+
+static bool enabled = false;
+static uint8_t duty = 100;
+static uint16_t voltage = 0;     /* mV, 0 until the first report */
+static uint16_t outages = 0;
+static bool browned_out = false; /* below V_MIN, not yet back at V_RESTART */
+
+/* State of the last control period */
+static uint16_t last_voltage = 0;
+static unsigned long last_time[ENERGEST_TYPE_MAX];
+static uint32_t income = 0;      /* uW, smoothed */
+
+static struct ctimer period_timer;
+static struct ctimer cycle_timer;
+static bool radio_held = false;
+/*---------------------------------------------------------------------------*/
+/* Energy held by the store at a voltage, in uJ */
+static uint32_t
+stored_energy(uint16_t mv)
+{
+  return (uint32_t)TPWSN_ENO_CAPACITANCE * ((uint32_t)mv * mv / 1000) / 2;
+}
+/*---------------------------------------------------------------------------*/
+/* Energy spent since the last call, in uJ */
+static uint32_t
+spent_energy(void)
+{
+  static const uint8_t types[] = {
+    ENERGEST_TYPE_CPU, ENERGEST_TYPE_LPM,
+    ENERGEST_TYPE_TRANSMIT, ENERGEST_TYPE_LISTEN
+  };
+  uint32_t uj = 0;
+  unsigned long now;
+  uint8_t i;
+
+  energest_flush();
+  for(i = 0; i < sizeof(types); ++i) {
+    now = energest_type_time(types[i]);
+    uj += tpwsn_energy_uj(types[i], now - last_time[types[i]], voltage);
+    last_time[types[i]] = now;
+  }
+  return uj;
+}
+/*---------------------------------------------------------------------------*/
+static void
+cycle(void *ptr)
+{
+  static bool on_phase = false;
+  clock_time_t on_time = (clock_time_t)TPWSN_ENO_CYCLE * duty / 100;
+
+  if(!enabled || tpwsn_wur_enabled() || !tpwsn_is_up()) {
+    return;
+  }
+
+  on_phase = !on_phase || duty >= 100;
+  if(on_phase) {
+    radio_held = false;
+    NETSTACK_RADIO.on();
+    ctimer_set(&cycle_timer, on_time > 0 ? on_time : 1, cycle, NULL);
+  } else {
+    // Stay on while the MAC is still sending
+    if(!radio_held && !tpwsn_mac_busy()) {
+      NETSTACK_RADIO.off();
+    }
+    ctimer_set(&cycle_timer, TPWSN_ENO_CYCLE - on_time, cycle, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+control(void *ptr)
+{
+  uint32_t spent, before, after, level;
+  int32_t stored;
+
+  ctimer_set(&period_timer, TPWSN_ENO_PERIOD, control, NULL);
+
+  spent = spent_energy();
+  if(voltage == 0 || last_voltage == 0) {
+    last_voltage = voltage;
+    return;
+  }
+
+  // Harvested energy = change of the stored energy + energy spent
+  before = stored_energy(last_voltage);
+  after = stored_energy(voltage);
+  stored = (int32_t)(after - before) + (int32_t)spent;
+  last_voltage = voltage;
+  if(stored < 0) {
+    stored = 0;
+  }
+  income = (3 * income + (uint32_t)stored * CLOCK_SECOND / TPWSN_ENO_PERIOD) / 4;
+
+  // The share of an always-listening node the income pays for, reduced
+  // while the store is below its target
+  level = income * 100 / ((uint32_t)TPWSN_ENERGY_LISTEN * voltage / 1000);
+  if(voltage < TPWSN_ENO_V_TARGET) {
+    level = voltage <= TPWSN_ENO_V_MIN ? 0 :
+      level * (voltage - TPWSN_ENO_V_MIN) / (TPWSN_ENO_V_TARGET - TPWSN_ENO_V_MIN);
+  }
+  if(level < TPWSN_ENO_MIN_DUTY) {
+    level = TPWSN_ENO_MIN_DUTY;
+  } else if(level > 100) {
+    level = 100;
+  }
+
+  if(level != duty) {
+    duty = level;
+    printf("%d.%d: eno duty %u income %lu voltage %u at %lu\n",
+           TPWSN_NODE, duty,
+           (unsigned long)income, voltage, (unsigned long)clock_time());
+    tpwsn_duty_changed(duty);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_set(bool on)
+{
+  enabled = on;
+  printf("Setting energy-neutral controller %s\n", enabled ? "on" : "off");
+
+  tpwsn_eno_stop();
+  if(enabled) {
+    if(browned_out) {
+      tpwsn_power_fail();
+    } else if(tpwsn_is_up()) {
+      tpwsn_eno_start();
+    }
+  } else {
+    tpwsn_power_restore();
+    if(tpwsn_is_up() && !tpwsn_wur_enabled()) {
+      NETSTACK_RADIO.on();
+    }
+    if(duty != 100) {
+      duty = 100;
+      tpwsn_duty_changed(duty);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_voltage(long mv)
+{
+  if(mv < 0) {
+    mv = 0;
+  }
+  voltage = mv > 0xffff ? 0xffff : mv;
+
+  // Brown out below V_MIN and restart above V_RESTART, the gap keeps
+  // the node from flapping around V_MIN
+  if(!browned_out && voltage < TPWSN_ENO_V_MIN) {
+    browned_out = true;
+    ++outages;
+    if(enabled) {
+      tpwsn_power_fail();
+    }
+  } else if(browned_out && voltage >= TPWSN_ENO_V_RESTART) {
+    browned_out = false;
+    tpwsn_power_restore();
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+tpwsn_eno_duty(void)
+{
+  return duty;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_tx(void)
+{
+  if(enabled && duty < 100 && !tpwsn_wur_enabled()) {
+    radio_held = true;
+    NETSTACK_RADIO.on();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_stop(void)
+{
+  ctimer_stop(&period_timer);
+  ctimer_stop(&cycle_timer);
+  radio_held = false;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_start(void)
+{
+  if(!enabled) {
+    return;
+  }
+  last_voltage = 0;
+  spent_energy();
+  ctimer_set(&period_timer, TPWSN_ENO_PERIOD, control, NULL);
+  cycle(NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_eno_stats(void)
+{
+  printf("%d.%d: eno on %d voltage %u income %lu duty %u outages %u "
+         "brownout %d\n",
+         TPWSN_NODE, enabled,
+         voltage, (unsigned long)income, duty, outages, browned_out);
+}
+/*---------------------------------------------------------------------------*/
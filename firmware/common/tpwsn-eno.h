@@ -0,0 +1,94 @@
+/**
+ * \file
+ *         Energy-neutral duty-cycle controller.
+ *
+ *         The simulation script reports the voltage of the node's
+ *         emulated energy store over serial with "voltage <mV>". Every
+ *         TPWSN_ENO_PERIOD the controller estimates the harvested power
+ *         as the change of the stored energy plus the energy the node
+ *         spent (from Energest), and derives a duty level in percent:
+ *         the share of an always-listening radio that the income pays
+ *         for, scaled down while the store is below its target voltage.
+ *
+ *         The duty level is applied to the radio, which is turned off
+ *         for the rest of every TPWSN_ENO_CYCLE, and handed to the
+ *         protocol's on_duty hook to scale its own rates.
+ *
+ *         While the controller is on, a voltage below TPWSN_ENO_V_MIN
+ *         takes the node down as a power loss would, and it restarts
+ *         once the voltage is back at TPWSN_ENO_V_RESTART.
+ *
+ *         Serial commands:
+ *
+ *         eno on|off       Turn the controller on or off
+ *         voltage <mV>     Report the storage voltage
+ */
+
+#ifndef TPWSN_ENO_H_
+#define TPWSN_ENO_H_
+
+#include "contiki.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Control period */
+#ifdef TPWSN_ENO_CONF_PERIOD
+#define TPWSN_ENO_PERIOD TPWSN_ENO_CONF_PERIOD
+#else
+#define TPWSN_ENO_PERIOD (10 * CLOCK_SECOND)
+#endif
+
+/* Radio duty cycle period */
+#ifdef TPWSN_ENO_CONF_CYCLE
+#define TPWSN_ENO_CYCLE TPWSN_ENO_CONF_CYCLE
+#else
+#define TPWSN_ENO_CYCLE CLOCK_SECOND
+#endif
+
+/* Capacitance of the energy store in mF */
+#ifdef TPWSN_ENO_CONF_CAPACITANCE
+#define TPWSN_ENO_CAPACITANCE TPWSN_ENO_CONF_CAPACITANCE
+#else
+#define TPWSN_ENO_CAPACITANCE 100
+#endif
+
+/* Storage voltage the controller aims for, the voltage below which
+   the node browns out, and the voltage at which it restarts */
+#ifdef TPWSN_ENO_CONF_V_TARGET
+#define TPWSN_ENO_V_TARGET TPWSN_ENO_CONF_V_TARGET
+#else
+#define TPWSN_ENO_V_TARGET 3000
+#endif
+#ifdef TPWSN_ENO_CONF_V_MIN
+#define TPWSN_ENO_V_MIN TPWSN_ENO_CONF_V_MIN
+#else
+#define TPWSN_ENO_V_MIN 2100
+#endif
+#ifdef TPWSN_ENO_CONF_V_RESTART
+#define TPWSN_ENO_V_RESTART TPWSN_ENO_CONF_V_RESTART
+#else
+#define TPWSN_ENO_V_RESTART 2400
+#endif
+
+/* Lowest duty level the controller sets */
+#define TPWSN_ENO_MIN_DUTY 5
+
+void tpwsn_eno_set(bool on);
+void tpwsn_eno_voltage(long mv);
+
+/* The current duty level in percent, 100 while the controller is off */
+uint8_t tpwsn_eno_duty(void);
+
+/* Keep the radio on until the end of the current cycle, called before
+   a transmission */
+void tpwsn_eno_tx(void);
+
+/* Stop and restart the controller when the node loses and regains
+   power */
+void tpwsn_eno_stop(void);
+void tpwsn_eno_start(void);
+
+void tpwsn_eno_stats(void);
+
+#endif /* TPWSN_ENO_H_ */
@@ -0,0 +1,392 @@
+/**
+ * \file
+ *         MAC wrapper with run-time parameters and statistics.
+ */
+
+#include "tpwsn-mac.h"
+#include "tpwsn.h"
+#include "tpwsn-eno.h"
+#include "tpwsn-wur.h"
+
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TPWSN_MAC_CONF_DRIVER
+#define TPWSN_MAC_DRIVER TPWSN_MAC_CONF_DRIVER
+#else
+#define TPWSN_MAC_DRIVER csma_driver
+#endif
+extern const struct mac_driver TPWSN_MAC_DRIVER;
+
+/* Contiki-NG changed the off() and last members of the driver */
+#ifdef TPWSN_CONF_CONTIKI_NG
+#define TPWSN_CONTIKI_NG TPWSN_CONF_CONTIKI_NG
+#else
+#define TPWSN_CONTIKI_NG 0
+#endif
+
+/* Packets that can be handed to the MAC at the same time, an upper
+   bound for the "queue" setting */
+#ifdef TPWSN_MAC_CONF_QUEUE
+#define TPWSN_MAC_QUEUE TPWSN_MAC_CONF_QUEUE
+#else
+#define TPWSN_MAC_QUEUE 8
+#endif
+
+/* Leave the number of transmissions to the MAC */
+#define RETRIES_DEFAULT 0xff
+
+/* Defaults of the Contiki-NG CSMA driver */
+unsigned char tpwsn_mac_min_be = 3;
+unsigned char tpwsn_mac_max_be = 5;
+unsigned char tpwsn_mac_max_backoff = 5;
+
+/* The Contiki 3 CSMA driver has a fixed backoff and never reads them */
+#if TPWSN_CONTIKI_NG
+#define NO_BACKOFF_EFFECT ""
+#else
+#define NO_BACKOFF_EFFECT " (no effect, the Contiki 3 CSMA backoff is fixed)"
+#endif
+
+static uint8_t max_retries = RETRIES_DEFAULT;
+static uint8_t queue_limit = TPWSN_MAC_QUEUE;
+
+/* The upper layer callback of each packet handed to the MAC. While the
+   wake-up radio is emulated the packet is held in a queuebuf until the
+   receiver has been woken up */
+struct pending_tx {
+  mac_callback_t sent;
+  void *ptr;
+  linkaddr_t receiver;
+  struct queuebuf *qb;
+  struct ctimer wake_timer;
+  bool used;
+};
+static struct pending_tx pending[TPWSN_MAC_QUEUE];
+
+static tpwsn_mac_sent_hook_t sent_hook;
+static tpwsn_mac_send_filter_t send_filter;
+
+static struct {
+  uint16_t unicast;
+  uint16_t broadcast;
+  uint16_t ok;
+  uint16_t busy;
+  uint16_t collision;
+  uint16_t noack;
+  uint16_t deferred;
+  uint16_t err;
+  uint16_t retries;
+  uint16_t queue_drops;
+  uint16_t filtered;
+} stats;
+/*---------------------------------------------------------------------------*/
+static void
+packet_sent(void *ptr, int status, int transmissions)
+{
+  struct pending_tx *p = ptr;
+
+  switch(status) {
+  case MAC_TX_OK:
+    ++stats.ok;
+    break;
+  case MAC_TX_COLLISION:
+    if(transmissions == 0) {
+      /* Every attempt found the channel busy (CCA), nothing was sent */
+      ++stats.busy;
+    } else {
+      /* The frame went on air but the last attempt collided */
+      ++stats.collision;
+    }
+    break;
+  case MAC_TX_NOACK:
+    ++stats.noack;
+    break;
+  case MAC_TX_DEFERRED:
+    ++stats.deferred;
+    break;
+  default:
+    ++stats.err;
+    break;
+  }
+  if(transmissions > 1) {
+    stats.retries += transmissions - 1;
+  }
+
+  p->used = false;
+  tpwsn_wur_listen(TPWSN_WUR_LINGER);
+  if(sent_hook != NULL) {
+    sent_hook(&p->receiver, status, transmissions);
+  }
+  mac_call_sent_callback(p->sent, p->ptr, status, transmissions);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_woken(void *ptr)
+{
+  struct pending_tx *p = ptr;
+
+  queuebuf_to_packetbuf(p->qb);
+  queuebuf_free(p->qb);
+  p->qb = NULL;
+  TPWSN_MAC_DRIVER.send(packet_sent, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  struct pending_tx *p = NULL;
+  uint8_t i, queued = 0;
+
+  for(i = 0; i < TPWSN_MAC_QUEUE; ++i) {
+    if(pending[i].used) {
+      ++queued;
+    } else if(p == NULL) {
+      p = &pending[i];
+    }
+  }
+
+  if(send_filter != NULL && !send_filter()) {
+    ++stats.filtered;
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+    return;
+  }
+
+  if(p == NULL || queued >= queue_limit) {
+    ++stats.queue_drops;
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+    return;
+  }
+
+  if(linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &linkaddr_null)) {
+    ++stats.broadcast;
+  } else {
+    ++stats.unicast;
+  }
+
+  if(max_retries != RETRIES_DEFAULT) {
+    packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS, max_retries + 1);
+  }
+
+  p->sent = sent;
+  p->ptr = ptr;
+  linkaddr_copy(&p->receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  p->used = true;
+
+  // The duty cycle of the energy-neutral controller may have turned the
+  // radio off
+  tpwsn_eno_tx();
+
+  if(tpwsn_wur_enabled()) {
+    // Wake the receiver up and send once it is listening
+    p->qb = queuebuf_new_from_packetbuf();
+    if(p->qb == NULL) {
+      p->used = false;
+      ++stats.queue_drops;
+      mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+      return;
+    }
+    tpwsn_wur_call(&p->receiver);
+    ctimer_set(&p->wake_timer, TPWSN_WUR_LATENCY, send_woken, p);
+    return;
+  }
+
+  TPWSN_MAC_DRIVER.send(packet_sent, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memset(pending, 0, sizeof(pending));
+  memset(&stats, 0, sizeof(stats));
+  TPWSN_MAC_DRIVER.init();
+}
+/*---------------------------------------------------------------------------*/
+static void
+input_packet(void)
+{
+  TPWSN_MAC_DRIVER.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return TPWSN_MAC_DRIVER.on();
+}
+/*---------------------------------------------------------------------------*/
+#if TPWSN_CONTIKI_NG
+static int
+off(void)
+{
+  return TPWSN_MAC_DRIVER.off();
+}
+/*---------------------------------------------------------------------------*/
+static int
+max_payload(void)
+{
+  return TPWSN_MAC_DRIVER.max_payload();
+}
+#else /* TPWSN_CONTIKI_NG */
+static int
+off(int keep_radio_on)
+{
+  return TPWSN_MAC_DRIVER.off(keep_radio_on);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  if(TPWSN_MAC_DRIVER.channel_check_interval != NULL) {
+    return TPWSN_MAC_DRIVER.channel_check_interval();
+  }
+  return 0;
+}
+#endif /* TPWSN_CONTIKI_NG */
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_mac_busy(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < TPWSN_MAC_QUEUE; ++i) {
+    if(pending[i].used) {
+      return true;
+    }
+  }
+  return false;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mac_flush(void)
+{
+  uint8_t i;
+  struct pending_tx *p;
+
+  /* Packets already handed to the MAC driver complete through its own
+     callback, only the ones waiting for the wake-up are ours to drop */
+  for(i = 0; i < TPWSN_MAC_QUEUE; ++i) {
+    p = &pending[i];
+    if(!p->used || p->qb == NULL) {
+      continue;
+    }
+    ctimer_stop(&p->wake_timer);
+    queuebuf_free(p->qb);
+    p->qb = NULL;
+    p->used = false;
+    ++stats.err;
+    if(sent_hook != NULL) {
+      sent_hook(&p->receiver, MAC_TX_ERR, 0);
+    }
+    mac_call_sent_callback(p->sent, p->ptr, MAC_TX_ERR, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mac_set_sent_hook(tpwsn_mac_sent_hook_t hook)
+{
+  sent_hook = hook;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mac_set_send_filter(tpwsn_mac_send_filter_t filter)
+{
+  send_filter = filter;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mac_command(char *ptr)
+{
+  static enum {
+    EXPECT_SETTING,
+    EXPECT_RETRIES,
+    EXPECT_MIN_BE,
+    EXPECT_MAX_BE,
+    EXPECT_BACKOFF,
+    EXPECT_QUEUE,
+  } expect = EXPECT_SETTING;
+  long value;
+
+  if(ptr == NULL) {
+    expect = EXPECT_SETTING;
+    return;
+  }
+
+  value = strtol(ptr, NULL, 10);
+
+  switch(expect) {
+  case EXPECT_RETRIES:
+    if(strcmp(ptr, "default") == 0 || value < 0 || value >= RETRIES_DEFAULT) {
+      max_retries = RETRIES_DEFAULT;
+      printf("Setting MAC retries to the MAC default\n");
+    } else {
+      max_retries = value;
+      printf("Setting MAC retries to %u\n", max_retries);
+    }
+    break;
+  case EXPECT_MIN_BE:
+    tpwsn_mac_min_be = value;
+    expect = EXPECT_MAX_BE;
+    return;
+  case EXPECT_MAX_BE:
+    tpwsn_mac_max_be = value;
+    printf("Setting MAC backoff exponents to %u-%u%s\n",
+           tpwsn_mac_min_be, tpwsn_mac_max_be, NO_BACKOFF_EFFECT);
+    break;
+  case EXPECT_BACKOFF:
+    tpwsn_mac_max_backoff = value;
+    printf("Setting MAC maximum backoffs to %u%s\n", tpwsn_mac_max_backoff,
+           NO_BACKOFF_EFFECT);
+    break;
+  case EXPECT_QUEUE:
+    queue_limit = value < 1 ? 1 : (value > TPWSN_MAC_QUEUE ? TPWSN_MAC_QUEUE : value);
+    printf("Setting MAC queue to %u\n", queue_limit);
+    break;
+  default:
+    if(strcmp(ptr, "retries") == 0) {
+      expect = EXPECT_RETRIES;
+    } else if(strcmp(ptr, "be") == 0) {
+      expect = EXPECT_MIN_BE;
+    } else if(strcmp(ptr, "backoff") == 0) {
+      expect = EXPECT_BACKOFF;
+    } else if(strcmp(ptr, "queue") == 0) {
+      expect = EXPECT_QUEUE;
+    }
+    return;
+  }
+  expect = EXPECT_SETTING;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mac_stats(void)
+{
+  printf("%d.%d: mac ucast %u bcast %u ok %u busy %u collision %u noack %u "
+         "deferred %u err %u retries %u queuedrop %u filtered %u\n",
+         TPWSN_NODE,
+         stats.unicast, stats.broadcast, stats.ok, stats.busy, stats.collision,
+         stats.noack, stats.deferred, stats.err, stats.retries,
+         stats.queue_drops, stats.filtered);
+  printf("%d.%d: mac params retries %u be %u-%u backoff %u queue %u\n",
+         TPWSN_NODE,
+         max_retries, tpwsn_mac_min_be, tpwsn_mac_max_be,
+         tpwsn_mac_max_backoff, queue_limit);
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver tpwsn_mac_driver = {
+  "tpwsn-mac",
+  init,
+  send_packet,
+  input_packet,
+  on,
+  off,
+#if TPWSN_CONTIKI_NG
+  max_payload,
+#else
+  channel_check_interval,
+#endif
+};
+/*---------------------------------------------------------------------------*/
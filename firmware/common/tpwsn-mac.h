@@ -0,0 +1,74 @@
+/**
+ * \file
+ *         MAC wrapper with run-time parameters and statistics.
+ *
+ *         tpwsn_mac_driver sits on top of the CSMA driver of the
+ *         network stack (TPWSN_MAC_CONF_DRIVER, csma_driver by default)
+ *         and is selected with
+ *
+ *           #define NETSTACK_CONF_MAC tpwsn_mac_driver
+ *
+ *         in the firmware's project-conf.h. It counts the outcome of
+ *         every transmission and applies the retry and queue limits set
+ *         over serial. The CSMA backoff exponents are only run-time
+ *         settings where the MAC reads them as expressions, which
+ *         project-conf.h arranges by defining the MAC's configuration
+ *         macros as tpwsn_mac_min_be, tpwsn_mac_max_be and
+ *         tpwsn_mac_max_backoff.
+ *
+ *         Serial commands, all following the "mac" keyword:
+ *
+ *         retries <n>|default   Maximum number of retransmissions
+ *         be <min> <max>        CSMA backoff exponents
+ *         backoff <n>           Maximum number of CCA backoffs
+ *         queue <n>             Maximum number of queued packets
+ *
+ *         be and backoff do nothing on Contiki 3 (the RMH build),
+ *         whose CSMA driver has a fixed backoff.
+ */
+
+#ifndef TPWSN_MAC_H_
+#define TPWSN_MAC_H_
+
+#include "net/linkaddr.h"
+#include "net/mac/mac.h"
+
+#include <stdbool.h>
+
+extern const struct mac_driver tpwsn_mac_driver;
+
+/* Run-time CSMA backoff parameters */
+extern unsigned char tpwsn_mac_min_be;
+extern unsigned char tpwsn_mac_max_be;
+extern unsigned char tpwsn_mac_max_backoff;
+
+/* Called with the receiver (linkaddr_null for broadcasts), the status and
+   the number of transmissions of every packet the MAC has finished with */
+typedef void (* tpwsn_mac_sent_hook_t)(const linkaddr_t *receiver,
+                                       int status, int transmissions);
+
+/* Set the hook, NULL removes it */
+void tpwsn_mac_set_sent_hook(tpwsn_mac_sent_hook_t hook);
+
+/* Called with every outgoing packet in the packet buffer, the packet is
+   dropped when it returns false */
+typedef bool (* tpwsn_mac_send_filter_t)(void);
+
+/* Set the filter, NULL removes it */
+void tpwsn_mac_set_send_filter(tpwsn_mac_send_filter_t filter);
+
+/* Whether packets are waiting in the MAC */
+bool tpwsn_mac_busy(void);
+
+/* Drop the packets held for the wake-up of their receiver, reporting
+   MAC_TX_ERR to the upper layer. Called when the node goes down */
+void tpwsn_mac_flush(void);
+
+/* Parse one serial token following the "mac" keyword, NULL at the end
+   of the line */
+void tpwsn_mac_command(char *token);
+
+/* Print the MAC counters and parameters */
+void tpwsn_mac_stats(void);
+
+#endif /* TPWSN_MAC_H_ */
@@ -0,0 +1,87 @@
+/**
+ * \file
+ *         RAM headroom instrumentation for the TPWSN firmwares.
+ */
+
+#include "tpwsn-mem.h"
+#include "tpwsn.h"
+
+
+#include <stdio.h>
+
+#if defined(__MSP430__) && defined(__GNUC__)
+
+#define STACK_PAINT ((char)0xa5)
+
+/* Bytes below the stack pointer that are left alone while painting,
+   they are in use by the painting function itself */
+#define STACK_PAINT_MARGIN 16
+
+/* Provided by the mspgcc linker script, the heap starts at __bss_end
+   and the stack grows down from __stack */
+extern char __bss_end;
+extern char __stack;
+
+/* The heap break of the Contiki msp430 sbrk(), where painting starts */
+extern void *sbrk(int incr);
+/*---------------------------------------------------------------------------*/
+static char *
+stack_pointer(void)
+{
+  char *sp;
+
+  asm volatile("mov r1, %0" : "=r"(sp));
+  return sp;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_mem_init(void)
+{
+  char *p = sbrk(0);
+  char *end = stack_pointer() - STACK_PAINT_MARGIN;
+
+  while(p < end) {
+    *p++ = STACK_PAINT;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The untouched RAM is the longest run of the paint between the end of
+ * .bss and the stack. Whatever lies below it is heap, whichever
+ * allocator grew it (sbrk() or the mspgcc malloc(), which does not move
+ * the break), and whatever lies above it is stack.
+ */
+void
+tpwsn_mem_stats(void)
+{
+  char *p, *start = &__bss_end, *gap = &__bss_end;
+  unsigned len = 0;
+
+  for(p = &__bss_end; p < &__stack; ++p) {
+    if(*p != STACK_PAINT) {
+      start = p + 1;
+    } else if(p + 1 - start > len) {
+      gap = start;
+      len = p + 1 - start;
+    }
+  }
+
+  printf("%d.%d: mem stack %u free %u heap %u\n",
+         TPWSN_NODE,
+         (unsigned)(&__stack - (gap + len)), len,
+         (unsigned)(gap - &__bss_end));
+}
+/*---------------------------------------------------------------------------*/
+#else /* __MSP430__ */
+
+void
+tpwsn_mem_init(void)
+{
+}
+
+void
+tpwsn_mem_stats(void)
+{
+}
+
+#endif /* __MSP430__ */
@@ -0,0 +1,25 @@
+/**
+ * \file
+ *         RAM headroom instrumentation for the TPWSN firmwares.
+ *
+ *         At start-up the free RAM between the top of the heap and the
+ *         stack is painted with a known pattern. The stack high-water
+ *         mark is the lowest address at which the pattern has been
+ *         overwritten, and the heap ends where the untouched run of the
+ *         pattern starts, so the heap is measured for any allocator.
+ *         Heap memory that was allocated but never written counts as
+ *         free. Only the MSP430 build with mspgcc is supported, other
+ *         platforms report nothing.
+ */
+
+#ifndef TPWSN_MEM_H_
+#define TPWSN_MEM_H_
+
+/* Paint the free RAM between the heap and the stack */
+void tpwsn_mem_init(void);
+
+/* Print the stack high-water mark, the untouched RAM between heap and
+   stack and the heap size */
+void tpwsn_mem_stats(void);
+
+#endif /* TPWSN_MEM_H_ */
@@ -0,0 +1,73 @@
+/**
+ * \file
+ *         Per-node provisioning compiled into the image, see
+ *         tpwsn-provision.h.
+ */
+
+#include "tpwsn-provision.h"
+#include "tpwsn.h"
+
+#include "sys/node-id.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if TPWSN_PROVISION
+/* Defines provision_table[], sorted by time */
+#include "provision-table.h"
+#else
+static const struct tpwsn_provision provision_table[] = {
+  { TPWSN_PROVISION_ALL, 0, NULL }
+};
+#endif
+
+#define TABLE_SIZE (sizeof(provision_table) / sizeof(provision_table[0]))
+
+/* Longest single wait, clock_time_t is only 16 bits on the Sky */
+#define MAX_WAIT 60
+
+static struct ctimer provision_timer;
+static uint16_t next = 0;
+static uint16_t elapsed = 0;  /* seconds since boot */
+static uint16_t waiting = 0;  /* seconds of the running wait */
+/*---------------------------------------------------------------------------*/
+static void
+run_due(void *ptr)
+{
+  static char line[TPWSN_PROVISION_LINE];
+  const struct tpwsn_provision *p;
+
+  elapsed += waiting;
+  for(; next < TABLE_SIZE && provision_table[next].at <= elapsed; ++next) {
+    p = &provision_table[next];
+    if(p->command == NULL ||
+       (p->node != TPWSN_PROVISION_ALL && p->node != node_id)) {
+      continue;
+    }
+    printf("Provisioned at %u s: %s\n", elapsed, p->command);
+
+    // The command is split in place, so it is run from a copy
+    strncpy(line, p->command, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    tpwsn_command(line);
+  }
+
+  if(next < TABLE_SIZE) {
+    waiting = provision_table[next].at - elapsed;
+    if(waiting > MAX_WAIT) {
+      waiting = MAX_WAIT;
+    }
+    ctimer_set(&provision_timer, (clock_time_t)waiting * CLOCK_SECOND,
+               run_due, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_provision_start(void)
+{
+  next = 0;
+  elapsed = 0;
+  waiting = 0;
+  run_due(NULL);
+}
+/*---------------------------------------------------------------------------*/
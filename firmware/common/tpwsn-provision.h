@@ -0,0 +1,51 @@
+/**
+ * \file
+ *         Per-node provisioning compiled into the image.
+ *
+ *         Instead of sending the initial commands to every mote over
+ *         serial, a table of command lines keyed by node ID is built into
+ *         the image, so that every mote of a simulation can run the same
+ *         image and start in its final configuration. Each entry is run
+ *         as if it had arrived over serial, at boot right after the
+ *         protocol has started, or a number of seconds later, which
+ *         gives a failure schedule with "sleep" entries.
+ *
+ *         The table is generated by tools/provision.py as
+ *         "provision-table.h" in the firmware directory and is only
+ *         included when the image is built with TPWSN_CONF_PROVISION
+ *         set to 1. The node ID is Contiki's node_id, the mote ID in
+ *         Cooja.
+ */
+
+#ifndef TPWSN_PROVISION_H_
+#define TPWSN_PROVISION_H_
+
+#include <stdint.h>
+
+#ifdef TPWSN_CONF_PROVISION
+#define TPWSN_PROVISION TPWSN_CONF_PROVISION
+#else
+#define TPWSN_PROVISION 0
+#endif
+
+/* Longest command line of the table */
+#define TPWSN_PROVISION_LINE 64
+
+/* Entries for every node */
+#define TPWSN_PROVISION_ALL 0
+
+struct tpwsn_provision {
+  /* Node the entry is for, TPWSN_PROVISION_ALL for every node */
+  uint16_t node;
+
+  /* Seconds after boot, 0 to run the entry at boot */
+  uint16_t at;
+
+  const char *command;
+};
+
+/* Run the entries due at boot and schedule the others, called by the
+   harness once the protocol has started */
+void tpwsn_provision_start(void);
+
+#endif /* TPWSN_PROVISION_H_ */
@@ -0,0 +1,110 @@
+/**
+ * \file
+ *         Wake-up radio emulation, see tpwsn-wur.h.
+ */
+
+#include "tpwsn-wur.h"
+#include "tpwsn.h"
+
+#include "net/netstack.h"
+
+#include <stdio.h>
+
+static bool enabled = false;
+static struct ctimer radio_timer;
+
+static uint16_t call_count = 0;
+static uint16_t wake_count = 0;
+/*---------------------------------------------------------------------------*/
+static void
+radio_off(void *ptr)
+{
+  if(enabled && tpwsn_is_up()) {
+    NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_wur_enabled(void)
+{
+  return enabled;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_set(bool on)
+{
+  enabled = on;
+  printf("Setting wake-up radio %s\n", enabled ? "on" : "off");
+
+  ctimer_stop(&radio_timer);
+  if(tpwsn_is_up()) {
+    if(enabled) {
+      NETSTACK_RADIO.off();
+    } else {
+      NETSTACK_RADIO.on();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_listen(clock_time_t time)
+{
+  if(!enabled || !tpwsn_is_up()) {
+    return;
+  }
+
+  NETSTACK_RADIO.on();
+  // Only ever extend the current listening period
+  if(ctimer_expired(&radio_timer) ||
+     timer_remaining(&radio_timer.etimer.timer) < time) {
+    ctimer_set(&radio_timer, time, radio_off, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_call(const linkaddr_t *receiver)
+{
+  uint8_t i;
+
+  ++call_count;
+  printf("%d.%d: WUC ", TPWSN_NODE);
+  for(i = 0; i < LINKADDR_SIZE; ++i) {
+    printf(i == 0 ? "%u" : ".%u", receiver->u8[i]);
+  }
+  printf("\n");
+
+  tpwsn_wur_listen(TPWSN_WUR_LATENCY + TPWSN_WUR_LINGER);
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_wake(long ms)
+{
+  if(!enabled || !tpwsn_is_up()) {
+    return;
+  }
+  ++wake_count;
+  tpwsn_wur_listen((clock_time_t)ms * CLOCK_SECOND / 1000 + 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_idle(void)
+{
+  if(enabled && ctimer_expired(&radio_timer)) {
+    NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_stop(void)
+{
+  ctimer_stop(&radio_timer);
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_wur_stats(void)
+{
+  printf("%d.%d: wur on %d calls %u wakes %u\n",
+         TPWSN_NODE,
+         enabled, call_count, wake_count);
+}
+/*---------------------------------------------------------------------------*/
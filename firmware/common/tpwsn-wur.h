@@ -0,0 +1,71 @@
+/**
+ * \file
+ *         Wake-up radio emulation.
+ *
+ *         With "wur on" the main radio stays off while the node is idle,
+ *         as if a low-power wake-up receiver listened in its place. The
+ *         wake-up receiver is emulated by the simulation script
+ *         tools/cooja/wake-up-radio.js:
+ *
+ *         - before every transmission the MAC wrapper prints
+ *             WUC <receiver>
+ *           (the link-layer address, all zero for a broadcast) and holds
+ *           the packet for TPWSN_WUR_LATENCY, with the radio on;
+ *         - the script answers with "wake <ms>" on the serial line of
+ *           the addressed mote, or of every mote in range for a
+ *           broadcast, which turns their radio on for <ms>.
+ *
+ *         Serial commands:
+ *
+ *         wur on|off    Turn the emulation on or off
+ *         wake <ms>     Turn the radio on for <ms>, sent by the script
+ */
+
+#ifndef TPWSN_WUR_H_
+#define TPWSN_WUR_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Delay between the wake-up call and the transmission */
+#ifdef TPWSN_WUR_CONF_LATENCY
+#define TPWSN_WUR_LATENCY TPWSN_WUR_CONF_LATENCY
+#else
+#define TPWSN_WUR_LATENCY (CLOCK_SECOND / 32)
+#endif
+
+/* Time the radio stays on after a transmission for the reply */
+#ifdef TPWSN_WUR_CONF_LINGER
+#define TPWSN_WUR_LINGER TPWSN_WUR_CONF_LINGER
+#else
+#define TPWSN_WUR_LINGER (CLOCK_SECOND / 16)
+#endif
+
+bool tpwsn_wur_enabled(void);
+
+/* Turn the emulation on or off */
+void tpwsn_wur_set(bool on);
+
+/* Send a wake-up call to a receiver, and keep the radio on until the
+   packet has been sent */
+void tpwsn_wur_call(const linkaddr_t *receiver);
+
+/* Keep the radio on for at least the given time */
+void tpwsn_wur_listen(clock_time_t time);
+
+/* Turn the radio on for the given time after a wake-up call */
+void tpwsn_wur_wake(long ms);
+
+/* Turn the radio off if the node is idle, called when power returns */
+void tpwsn_wur_idle(void);
+
+/* Stop the radio timer when the node loses power */
+void tpwsn_wur_stop(void);
+
+/* Print the wake-up counters */
+void tpwsn_wur_stats(void);
+
+#endif /* TPWSN_WUR_H_ */
@@ -0,0 +1,388 @@
+/**
+ * \file
+ *         Experiment harness shared by the TPWSN broadcast protocol
+ *         firmwares.
+ *
+ *         The harness does not run a process of its own. The protocol
+ *         process passes every event it does not handle itself to
+ *         tpwsn_event(), so that timers set by the protocol hooks stay
+ *         bound to the protocol process.
+ */
+
+#include "tpwsn.h"
+#include "tpwsn-collect.h"
+#include "tpwsn-energy.h"
+#include "tpwsn-eno.h"
+#include "tpwsn-mac.h"
+#include "tpwsn-mem.h"
+#include "tpwsn-provision.h"
+#include "tpwsn-wur.h"
+
+#include "net/netstack.h"
+#include "sys/energest.h"
+
+#include "dev/leds.h"
+#include "dev/serial-line.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct tpwsn_protocol *proto;
+
+/* Node role */
+static bool is_source = false;
+static bool is_sink = false;
+
+/* Power state: a node is down while it emulates a power loss and
+   halted for good once it has been told to print its coverage */
+static bool is_up = true;
+static bool halted = false;
+static struct etimer rt; /* Used to 'restart' the node */
+
+/* Cleared while the energy store is browned out, the node then stays
+   down until tpwsn_power_restore() */
+static bool powered = true;
+
+static uint16_t energy_level = 0;
+
+/* Counters reported by the "stats" command */
+static uint16_t rx_count = 0;
+static uint16_t tx_count = 0;
+static uint16_t restart_count = 0;
+/*---------------------------------------------------------------------------*/
+static void
+power_down(void)
+{
+  if(is_up) {
+    proto->on_sleep();
+    tpwsn_collect_stop();
+    tpwsn_wur_stop();
+    tpwsn_mac_flush();
+    tpwsn_eno_stop();
+    NETSTACK_RADIO.off();
+    leds_on(LEDS_ALL);
+    is_up = false;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+sleep_node(long delay)
+{
+  if(halted) {
+    return;
+  }
+
+  printf("%d.%d: Crashing mote, restart in %ld seconds\n",
+         TPWSN_NODE, delay);
+
+  power_down();
+  etimer_set(&rt, delay * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+static void
+restart_node(void)
+{
+  printf("%d.%d: Restarting node at time %lu\n",
+         TPWSN_NODE,
+         (unsigned long) clock_time());
+
+  etimer_stop(&rt);
+  NETSTACK_RADIO.on();
+  leds_off(LEDS_ALL);
+  is_up = true;
+  ++restart_count;
+  proto->on_restart();
+  tpwsn_collect_start();
+  tpwsn_wur_idle();
+  tpwsn_eno_start();
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_coverage(void)
+{
+  if(proto->print != NULL) {
+    proto->print();
+  } else {
+    printf("Current token: %u\n", proto->coverage_state());
+  }
+
+  /* Stop the node so that its coverage state does not change after it
+     has been reported */
+  if(is_up) {
+    proto->on_sleep();
+    tpwsn_collect_stop();
+    tpwsn_wur_stop();
+    tpwsn_mac_flush();
+    tpwsn_eno_stop();
+    NETSTACK_RADIO.off();
+  }
+  etimer_stop(&rt);
+  is_up = false;
+  halted = true;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(void)
+{
+  printf("%d.%d: stats %s source %d sink %d up %d rx %u tx %u restarts %u "
+         "coverage %u energy %u\n",
+         TPWSN_NODE, proto->name,
+         is_source, is_sink, is_up, rx_count, tx_count, restart_count,
+         proto->coverage_state(), energy_level);
+
+  energest_flush();
+  printf("%d.%d: energest cpu %lu lpm %lu tx %lu rx %lu\n",
+         TPWSN_NODE,
+         (unsigned long) energest_type_time(ENERGEST_TYPE_CPU),
+         (unsigned long) energest_type_time(ENERGEST_TYPE_LPM),
+         (unsigned long) energest_type_time(ENERGEST_TYPE_TRANSMIT),
+         (unsigned long) energest_type_time(ENERGEST_TYPE_LISTEN));
+  tpwsn_energy_stats();
+
+  tpwsn_mem_stats();
+  tpwsn_mac_stats();
+  tpwsn_wur_stats();
+  tpwsn_eno_stats();
+
+  if(proto->stats != NULL) {
+    proto->stats();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_energy(long level)
+{
+  energy_level = level > 0xffff ? 0xffff : (level < 0 ? 0 : level);
+  printf("Setting energy level to %u\n", energy_level);
+
+  if(proto->on_energy != NULL) {
+    proto->on_energy(energy_level);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+serial_handler(char *data)
+{
+  char *ptr = strtok(data, " ");
+  long delay = 0;
+  bool seen_set = false;
+  bool seen_sleep = false;
+  bool seen_energy = false;
+  bool seen_mac = false;
+  bool seen_collect = false;
+  bool seen_wur = false;
+  bool seen_wake = false;
+  bool seen_eno = false;
+  bool seen_voltage = false;
+
+  // Iterate over the tokenised string
+  while(ptr != NULL) {
+    if(seen_mac) {
+      // The rest of the line sets MAC parameters
+      tpwsn_mac_command(ptr);
+    } else if(seen_set) {
+      // Parse serial input to set a node as a sink or source
+      if(strcmp(ptr, "sink") == 0) {
+        printf("Setting node status to SINK\n");
+        is_sink = true;
+      } else if(strcmp(ptr, "source") == 0) {
+        printf("Setting node status to SOURCE\n");
+        is_source = true;
+      }
+      seen_set = false;
+    } else if(seen_sleep) {
+      // Parse serial input for restarting a node
+      delay = strtol(ptr, NULL, 10);
+      seen_sleep = false;
+    } else if(seen_energy) {
+      // Parse serial input to set the emulated energy level
+      set_energy(strtol(ptr, NULL, 10));
+      seen_energy = false;
+    } else if(seen_collect) {
+      // Parse serial input to set the coverage collection period
+      tpwsn_collect_set_period(strtol(ptr, NULL, 10));
+      seen_collect = false;
+    } else if(seen_wur) {
+      // Parse serial input to emulate a wake-up radio
+      tpwsn_wur_set(strcmp(ptr, "on") == 0);
+      seen_wur = false;
+    } else if(seen_wake) {
+      // Parse a wake-up call from the simulation script
+      tpwsn_wur_wake(strtol(ptr, NULL, 10));
+      seen_wake = false;
+    } else if(seen_eno) {
+      // Parse serial input for the energy-neutral controller
+      tpwsn_eno_set(strcmp(ptr, "on") == 0);
+      seen_eno = false;
+    } else if(seen_voltage) {
+      // Parse the storage voltage reported by the simulation script
+      tpwsn_eno_voltage(strtol(ptr, NULL, 10));
+      seen_voltage = false;
+    } else if(strcmp(ptr, "set") == 0) {
+      seen_set = true;
+    } else if(strcmp(ptr, "sleep") == 0) {
+      seen_sleep = true;
+    } else if(strcmp(ptr, "energy") == 0) {
+      seen_energy = true;
+    } else if(strcmp(ptr, "eno") == 0) {
+      seen_eno = true;
+    } else if(strcmp(ptr, "voltage") == 0) {
+      seen_voltage = true;
+    } else if(strcmp(ptr, "wur") == 0) {
+      seen_wur = true;
+    } else if(strcmp(ptr, "wake") == 0) {
+      seen_wake = true;
+    } else if(strcmp(ptr, "collect") == 0) {
+      seen_collect = true;
+    } else if(strcmp(ptr, "mac") == 0) {
+      seen_mac = true;
+    } else if(strcmp(ptr, "print") == 0) {
+      print_coverage();
+    } else if(strcmp(ptr, "stats") == 0) {
+      print_stats();
+    } else if(proto->command != NULL) {
+      proto->command(ptr);
+    }
+
+    ptr = strtok(NULL, " ");
+  }
+
+  if(seen_mac) {
+    tpwsn_mac_command(NULL);
+  }
+  if(proto->command != NULL) {
+    proto->command(NULL);
+  }
+
+  // If the mote has been told to sleep then it can sleep
+  if(delay > 0) {
+    sleep_node(delay);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_command(char *line)
+{
+  serial_handler(line);
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_init(const struct tpwsn_protocol *protocol)
+{
+  proto = protocol;
+
+  // Paint the free RAM to measure the stack high-water mark
+  tpwsn_mem_init();
+
+  // Initialise the serial line
+  serial_line_init();
+
+  proto->init();
+
+  // Apply the configuration built into the image
+  tpwsn_provision_start();
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_event(process_event_t ev, process_data_t data)
+{
+  if(ev == serial_line_event_message && data != NULL) {
+    serial_handler(data);
+    return true;
+  }
+  if(ev == PROCESS_EVENT_TIMER && data == &rt) {
+    if(!is_up && !halted && powered) {
+      restart_node();
+    }
+    return true;
+  }
+  return false;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_rx(const void *data, uint16_t len)
+{
+  if(!is_up) {
+    return;
+  }
+  ++rx_count;
+  proto->on_rx(data, len);
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_tx(void)
+{
+  if(!is_up) {
+    return false;
+  }
+  ++tx_count;
+  return true;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_power_fail(void)
+{
+  if(halted || !powered) {
+    return;
+  }
+
+  printf("%d.%d: Crashing mote, brownout at time %lu\n",
+         TPWSN_NODE, (unsigned long) clock_time());
+
+  powered = false;
+  power_down();
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_power_restore(void)
+{
+  if(powered) {
+    return;
+  }
+  powered = true;
+
+  // A pending "sleep" keeps the node down until its own timer expires
+  if(!is_up && !halted && etimer_expired(&rt)) {
+    restart_node();
+  }
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_is_up(void)
+{
+  return is_up;
+}
+/*---------------------------------------------------------------------------*/
+void
+tpwsn_duty_changed(uint8_t duty)
+{
+  if(proto->on_duty != NULL) {
+    proto->on_duty(duty);
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+tpwsn_coverage_state(void)
+{
+  return proto->coverage_state();
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_is_source(void)
+{
+  return is_source;
+}
+/*---------------------------------------------------------------------------*/
+bool
+tpwsn_is_sink(void)
+{
+  return is_sink;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+tpwsn_energy(void)
+{
+  return energy_level;
+}
+/*---------------------------------------------------------------------------*/
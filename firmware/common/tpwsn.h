@@ -0,0 +1,130 @@
+/**
+ * \file
+ *         Experiment harness shared by the TPWSN broadcast protocol
+ *         firmwares.
+ *
+ *         The harness owns everything that is not part of the protocol
+ *         under test: the node role, the serial control interface,
+ *         the emulation of power loss and restarts, and the counters
+ *         used to measure coverage. Each protocol describes itself with
+ *         a struct tpwsn_protocol and hands it to tpwsn_init(), so that
+ *         every protocol is driven and measured in the same way.
+ *
+ *         Serial commands handled by the harness:
+ *
+ *         set sink|source   Set the role of the node
+ *         sleep <seconds>   Emulate a power loss for the given time
+ *         print             Print the coverage state and stop the node
+ *         stats             Print the harness and protocol counters
+ *         energy <level>    Set the emulated energy level of the node
+ *         mac ...           Set MAC parameters, see tpwsn-mac.h
+ *         collect <seconds> Set the coverage collection period, see
+ *                           tpwsn-collect.h
+ *         wur on|off        Emulate a wake-up radio, see tpwsn-wur.h
+ *         wake <ms>         Wake-up call from the simulation script
+ *         eno on|off        Run the energy-neutral controller, see
+ *                           tpwsn-eno.h
+ *         voltage <mV>      Storage voltage from the simulation script
+ *
+ *         Every other token is passed to the protocol's command hook.
+ */
+
+#ifndef TPWSN_H_
+#define TPWSN_H_
+
+#include "contiki.h"
+#include "sys/node-id.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Arguments for the "%d.%d" prefix of the harness log lines: the node
+   ID split like a Rime address. On Contiki 3 this is the link address,
+   on Contiki-NG the first bytes of the link address are the same on
+   every node, so the node ID is used on both */
+#define TPWSN_NODE (node_id & 0xff), (node_id >> 8)
+
+struct tpwsn_protocol {
+  /* Name printed in the statistics output */
+  const char *name;
+
+  /* Called once at boot to open connections and start the protocol */
+  void (* init)(void);
+
+  /* Called when the node loses power, the protocol must stop all of
+     its activity and forget its volatile state */
+  void (* on_sleep)(void);
+
+  /* Called when power returns after on_sleep(), the protocol restarts
+     from the state it has after a reboot */
+  void (* on_restart)(void);
+
+  /* Called for every protocol message received while the node is up */
+  void (* on_rx)(const void *data, uint16_t len);
+
+  /* The version of the disseminated data held by this node, 0 if the
+     node has not received anything yet */
+  uint16_t (* coverage_state)(void);
+
+  /* Print protocol specific counters, may be NULL */
+  void (* stats)(void);
+
+  /* Parse one serial token the harness did not consume, called with
+     NULL at the end of each line. The line is being split with strtok()
+     so the hook must not call it. May be NULL */
+  void (* command)(char *token);
+
+  /* Called when the emulated energy level changes, may be NULL */
+  void (* on_energy)(uint16_t level);
+
+  /* Called when the energy-neutral controller changes the duty level
+     (percent, 100 for full activity). The protocol scales its own
+     periodic traffic to it. May be NULL */
+  void (* on_duty)(uint8_t duty);
+
+  /* Print the coverage state for the "print" command as
+     "Current token: <state>", may be NULL to print coverage_state() */
+  void (* print)(void);
+};
+
+/* Start the harness and the protocol, called from the protocol process */
+void tpwsn_init(const struct tpwsn_protocol *protocol);
+
+/* Run a command line as if it had been received over serial. The line
+   is split in place */
+void tpwsn_command(char *line);
+
+/* Handle a serial line or harness timer event. The protocol process
+   passes every event it does not handle itself, returns true if the
+   event was consumed */
+bool tpwsn_event(process_event_t ev, process_data_t data);
+
+/* Hand a received protocol message to the harness. The message is
+   counted and passed on to the protocol's on_rx hook if the node is up */
+void tpwsn_rx(const void *data, uint16_t len);
+
+/* Account for a transmission. Returns false if the node is down and
+   must not transmit */
+bool tpwsn_tx(void);
+
+/* Emulate a brownout: the node goes down as after "sleep" but stays
+   down until tpwsn_power_restore() */
+void tpwsn_power_fail(void);
+void tpwsn_power_restore(void);
+
+/* Whether the node is powered and running the protocol */
+bool tpwsn_is_up(void);
+
+/* Hand a new duty level to the protocol, called by the controller */
+void tpwsn_duty_changed(uint8_t duty);
+
+/* The protocol's coverage state */
+uint16_t tpwsn_coverage_state(void);
+
+bool tpwsn_is_source(void);
+bool tpwsn_is_sink(void);
+
+/* The emulated energy level set with the "energy" command */
+uint16_t tpwsn_energy(void);
+
+#endif /* TPWSN_H_ */
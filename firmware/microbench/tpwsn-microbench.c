@@ -0,0 +1,227 @@
+/**
+ * \file
+ *         Microbenchmarks of the Contiki library calls on the protocol
+ *         hot paths: the Trickle timer events, list_length(),
+ *         list_chop(), memb_alloc() and ctimer_set().
+ *
+ *         Each primitive is called BENCH_ITERATIONS times between two
+ *         reads of RTIMER_NOW(), for BENCH_ROUNDS rounds, and the
+ *         fastest round is kept so that interrupts do not inflate the
+ *         figures. The result is printed as one CSV line per primitive
+ *         and parameter:
+ *
+ *           BENCH,<primitive>,<param>,<iterations>,<ticks>,<cycles>
+ *
+ *         where <param> is the list length, pool occupancy or number of
+ *         other active timers, <ticks> the rtimer ticks of the fastest
+ *         round and <cycles> the CPU cycles per call, F_CPU cycles per
+ *         second. The "empty" line is the cost of the loop and of calling
+ *         an empty function, to be subtracted from the others.
+ */
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "lib/trickle-timer.h"
+#include "sys/ctimer.h"
+#include "sys/rtimer.h"
+
+#include <stdio.h>
+
+#define BENCH_ITERATIONS 500
+#define BENCH_ROUNDS     5
+
+/* Largest list and pool, and the most background timers */
+#define BENCH_MAX_ITEMS  32
+#define BENCH_MAX_TIMERS 16
+
+/* Clock of the CPU, the Sky runs its DCO at 3.9 MHz */
+#ifndef F_CPU
+#define F_CPU 3900000UL
+#endif
+
+struct item {
+  struct item *next;
+  uint16_t value;
+};
+
+LIST(bench_list);
+MEMB(bench_mem, struct item, BENCH_MAX_ITEMS);
+
+static struct item list_items[BENCH_MAX_ITEMS];
+static struct item *pool_items[BENCH_MAX_ITEMS];
+static struct ctimer background[BENCH_MAX_TIMERS];
+static struct ctimer bench_timer;
+static struct trickle_timer tt;
+
+/* Keeps the compiler from dropping calls whose result is unused */
+static volatile uint16_t sink;
+
+static const uint8_t sizes[] = { 0, 1, 4, 8, 16, 32 };
+static const uint8_t loads[] = { 0, 4, 8, 16 };
+
+PROCESS(microbench_process, "TPWSN microbenchmarks");
+AUTOSTART_PROCESSES(&microbench_process);
+/*---------------------------------------------------------------------------*/
+static void __attribute__((noinline))
+empty(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+noop(void *ptr)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+trickle_noop(void *ptr, uint8_t suppress)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *primitive, uint8_t param, rtimer_clock_t ticks)
+{
+  printf("BENCH,%s,%u,%u,%u,%lu\n", primitive, param, BENCH_ITERATIONS,
+         (unsigned)ticks,
+         (unsigned long)((uint64_t)ticks * F_CPU / RTIMER_SECOND /
+                         BENCH_ITERATIONS));
+}
+/*---------------------------------------------------------------------------*/
+/* Time BENCH_ITERATIONS runs of a statement, fastest of BENCH_ROUNDS */
+#define MEASURE(primitive, param, statement) do {                       \
+    rtimer_clock_t best = (rtimer_clock_t)~0;                           \
+    rtimer_clock_t start, ticks;                                        \
+    uint8_t round;                                                      \
+    uint16_t i;                                                         \
+    for(round = 0; round < BENCH_ROUNDS; ++round) {                     \
+      start = RTIMER_NOW();                                             \
+      for(i = 0; i < BENCH_ITERATIONS; ++i) {                           \
+        statement;                                                      \
+      }                                                                 \
+      ticks = RTIMER_NOW() - start;                                     \
+      if(ticks < best) {                                                \
+        best = ticks;                                                   \
+      }                                                                 \
+    }                                                                   \
+    report(primitive, param, best);                                     \
+  } while(0)
+/*---------------------------------------------------------------------------*/
+static void
+fill_list(uint8_t size)
+{
+  uint8_t i;
+
+  list_init(bench_list);
+  for(i = 0; i < size; ++i) {
+    list_items[i].value = i;
+    list_add(bench_list, &list_items[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_lists(void)
+{
+  struct item *item;
+  uint8_t s;
+
+  for(s = 0; s < sizeof(sizes); ++s) {
+    fill_list(sizes[s]);
+    MEASURE("list_length", sizes[s], sink = list_length(bench_list));
+
+    // list_add() walks the list as well, so it is measured on its own
+    // and as the pair that keeps the length constant
+    if(sizes[s] > 0) {
+      MEASURE("list_chop+list_add", sizes[s],
+              item = list_chop(bench_list); list_add(bench_list, item));
+      item = list_chop(bench_list);
+      MEASURE("list_add+list_remove", sizes[s] - 1,
+              list_add(bench_list, item); list_remove(bench_list, item));
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_memb(void)
+{
+  struct item *item;
+  uint8_t s, i;
+
+  for(s = 0; s < sizeof(sizes); ++s) {
+    if(sizes[s] >= BENCH_MAX_ITEMS) {
+      continue;
+    }
+    memb_init(&bench_mem);
+    for(i = 0; i < sizes[s]; ++i) {
+      pool_items[i] = memb_alloc(&bench_mem);
+    }
+    MEASURE("memb_alloc+memb_free", sizes[s],
+            item = memb_alloc(&bench_mem); memb_free(&bench_mem, item));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_load(uint8_t load)
+{
+  uint8_t i;
+
+  for(i = 0; i < BENCH_MAX_TIMERS; ++i) {
+    if(i < load) {
+      ctimer_set(&background[i], 400 * CLOCK_SECOND + i, noop, NULL);
+    } else {
+      ctimer_stop(&background[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_timers(void)
+{
+  uint8_t l;
+
+  for(l = 0; l < sizeof(loads); ++l) {
+    set_load(loads[l]);
+
+    MEASURE("ctimer_set", loads[l],
+            ctimer_set(&bench_timer, 100 * CLOCK_SECOND, noop, NULL));
+    ctimer_stop(&bench_timer);
+
+    trickle_timer_config(&tt, 16, 10, 2);
+    trickle_timer_set(&tt, trickle_noop, NULL);
+    MEASURE("trickle_timer_consistency", loads[l],
+            trickle_timer_consistency(&tt));
+
+    // Both only reset the timer when it is past Imin, so it is moved
+    // out of Imin before every call
+    MEASURE("trickle_timer_inconsistency", loads[l],
+            tt.i_cur = tt.i_min << 1; trickle_timer_inconsistency(&tt));
+    MEASURE("trickle_timer_reset_event", loads[l],
+            tt.i_cur = tt.i_min << 1; trickle_timer_reset_event(&tt));
+    trickle_timer_stop(&tt);
+  }
+  set_load(0);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(microbench_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  // Let the boot output and the radio settle
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  printf("BENCH,primitive,param,iterations,ticks,cycles\n");
+  MEASURE("empty", 0, empty());
+
+  bench_lists();
+  bench_memb();
+
+  // ctimer_set() binds the timers to the current process
+  bench_timers();
+
+  printf("BENCH,done,0,0,0,0\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
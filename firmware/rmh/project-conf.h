@@ -0,0 +1,16 @@
+/**
+ * \file
+ *         Contiki configuration of the Rime Multihop firmware.
+ *
+ *         Contiki 3 only reads this file when the image is built with
+ *         DEFINES=PROJECT_CONF_H=\"project-conf.h\".
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+/* Run CSMA under the harness MAC wrapper for run-time retry and queue
+   limits and per-outcome transmission counters */
+#define NETSTACK_CONF_MAC tpwsn_mac_driver
+
+#endif /* PROJECT_CONF_H_ */
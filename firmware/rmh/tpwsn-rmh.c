@@ -80,36 +80,412 @@
 #include "lib/random.h"
 
 #include "dev/button-sensor.h"
-#include "dev/leds.h"
-#include "dev/serial-line.h"
+
+#include "tlog.h"
+#include "tpwsn.h"
+#include "tpwsn-collect.h"
+#include "tpwsn-mac.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define CHANNEL 135
 
+/* Rime channel of the broadcasts carrying coverage summaries */
+#define COLLECT_CHANNEL (CHANNEL + 1)
+
+/* Rime channel of the broadcasts carrying neighbor lists */
+#define CDS_CHANNEL (CHANNEL + 2)
+
 // The message that was received (for coverage purposes)
 #define DATA_BUF_SIZE 6
 static char *data_buf;
-// The restart delay timer
-static struct etimer rt;
-static bool reset_scheduled = false;
+
+/*
+ * Next-hop selection policy used by forward(). FORWARD_UNIFORM is the
+ * original random walk, FORWARD_ENERGY weights each neighbor by the
+ * energy hint it advertises so that nodes expected to stay powered are
+ * preferred as relays. FORWARD_GEO greedily picks the neighbor closest
+ * to the destination's coordinates (of the first sink only) and
+ * FORWARD_GRADIENT picks the neighbor with the lowest hop distance to
+ * the nearest sink. Both fall back to a uniform choice when no neighbor
+ * makes progress.
+ */
+enum forward_policy {
+  FORWARD_UNIFORM,
+  FORWARD_ENERGY,
+  FORWARD_GEO,
+  FORWARD_GRADIENT,
+};
+static enum forward_policy forward_policy = FORWARD_UNIFORM;
+
+/*
+ * The energy hint advertised in the announcement value is the energy
+ * level of the harness, which the experiment sets over serial with
+ * "energy <seconds>" to the expected remaining uptime of the node.
+ */
+#define ENERGY_HINT_DEFAULT 0
+
+/*
+ * Node coordinates are configured over serial with "pos <x> <y>" and
+ * the coordinates of the sink with "dest <x> <y>". Both are in grid
+ * units of 0-254 so that a position fits in one announcement value
+ * (255, 255 is reserved for an unknown position).
+ */
+struct position {
+  uint8_t x;
+  uint8_t y;
+};
+#define POSITION_UNKNOWN 0xffff
+static struct position position;
+static struct position dest_position;
+static bool has_position = false;
+static bool has_dest_position = false;
+
+/*
+ * Hop distance to the nearest live sink, advertised in its own
+ * announcement. Sinks advertise 0 and every other node one more than
+ * its closest neighbor.
+ */
+#define GRADIENT_MAX 0xff
+static uint8_t gradient = GRADIENT_MAX;
+
+/*
+ * When our route gets worse, because the neighbor we counted from timed
+ * out or advertised a larger gradient, the gradients of the other
+ * neighbors may have been learned from us. We then poison the route:
+ * advertise GRADIENT_MAX and ignore the neighbors' gradients for
+ * GRADIENT_HOLD, so that the nodes downstream of us drop their routes
+ * through us too before we pick a new one, instead of counting up
+ * toward GRADIENT_MAX at the announcement rate.
+ */
+#define GRADIENT_HOLD (10 * CLOCK_SECOND)
+static struct ctimer gradient_timer;
+static bool gradient_held = false;
+
+/*
+ * The sinks of the network, configured over serial with
+ * "sinks <id> [<id> ...]". Packets are addressed to the first sink but
+ * are delivered at whichever sink they reach first (anycast). The
+ * default of a single sink at 1.0 is a value that happens to work
+ * nicely in a Cooja simulation (because the default simulation setup
+ * creates one node with address 1.0). A new list is parsed into
+ * new_sinks and only replaces the old one if it holds at least one ID.
+ *
+ * FORWARD_GEO steers towards the single position set with "dest",
+ * which should be that of the first sink, the one packets are
+ * addressed to.
+ */
+#define MAX_SINKS 4
+static linkaddr_t sinks[MAX_SINKS] = { { { 1, 0 } } };
+static uint8_t num_sinks = 1;
+static linkaddr_t new_sinks[MAX_SINKS];
+static uint8_t num_new_sinks;
+
+/*
+ * Connected dominating set backbone, enabled over serial with "cds on".
+ * Nodes periodically broadcast the IDs of their neighbors so that every
+ * node knows its two-hop neighborhood, and mark themselves with the
+ * Wu-Li rules: a node is marked if two of its neighbors are not
+ * neighbors of each other, and unmarks itself again if a marked
+ * neighbor with a higher ID covers all of its neighbors (rule 1).
+ * Marked nodes form the backbone and forward() only relays to backbone
+ * neighbors and sinks. Neighbor lists are truncated to CDS_MAX_LIST
+ * entries, which can only add nodes to the backbone. The lists carry
+ * full link addresses and IDs are compared on both bytes, so that
+ * nodes above 255 are told apart.
+ */
+#define CDS_INTERVAL (10 * CLOCK_SECOND)
+#ifdef CDS_CONF_MAX_LIST
+#define CDS_MAX_LIST CDS_CONF_MAX_LIST
+#else
+#define CDS_MAX_LIST 8
+#endif
+#define CDS_MARKED   0x01
+#define CDS_BACKBONE 0x02
+struct neighbor_list {
+  uint8_t flags;
+  uint8_t count;
+  linkaddr_t ids[CDS_MAX_LIST];
+};
+static bool cds_enabled = false;
+static bool cds_marked = false;
+static bool cds_backbone = false;
+static struct ctimer cds_timer;
+
+/*
+ * Optional header extension carried in the payload after the
+ * DATA_BUF_SIZE bytes of the message, started by a byte of EXT_ flags.
+ * With "bloom <bytes>" the originator adds a Bloom filter of the nodes
+ * that have relayed the packet: a length byte followed by that many
+ * bytes of filter, at most BLOOM_MAX. Each relay adds itself with
+ * BLOOM_HASHES hash functions of its ID and forward() prefers neighbors
+ * that are not in the filter. A bigger filter lowers the rate of false
+ * positives, neighbors wrongly taken for visited ones.
+ * With "path on" the originator adds a path record: a count byte (the
+ * top bit flags an overflow) followed by PATH_MAX entries at most of the
+ * ID of each relaying node and the low 16 bits of its clock_time() when
+ * it relayed the packet. Each relay appends its entry, and the sink
+ * appends its own and prints the path.
+ */
+#define EXT_PATH  0x01
+#define EXT_BLOOM 0x02
+#define BLOOM_MAX 16
+#define BLOOM_HASHES 2
+static uint8_t bloom_len = 0;
+#ifdef RMH_CONF_PATH_MAX
+#define PATH_MAX RMH_CONF_PATH_MAX
+#else
+#define PATH_MAX 8
+#endif
+#define PATH_OVERFLOW   0x80
+#define PATH_ENTRY_SIZE 3
+/*
+ * Payload bytes a multihop packet can carry in one 802.15.4 frame: 127
+ * bytes less the frame header and FCS with short addresses (11) and
+ * the Rime multihop, unicast and broadcast headers (14).
+ */
+#ifdef RMH_CONF_MAX_PAYLOAD
+#define MAX_PAYLOAD RMH_CONF_MAX_PAYLOAD
+#else
+#define MAX_PAYLOAD (127 - 11 - 14)
+#endif
+#if DATA_BUF_SIZE + 1 + (1 + BLOOM_MAX) + 1 + PATH_MAX * PATH_ENTRY_SIZE > MAX_PAYLOAD
+#error "RMH_CONF_PATH_MAX entries do not fit in MAX_PAYLOAD with the largest Bloom filter"
+#endif
+static bool path_enabled = false;
+
+/* Counters reported by the "stats" serial command */
+static uint16_t delivered_count = 0;
+static uint16_t forwarded_count = 0;
+static uint16_t dropped_count = 0;
+
+/* Announcement IDs, the first one is the same as the Rime channel we
+   use to open the multihop connection. */
+#define ENERGY_ANNOUNCEMENT_ID   CHANNEL
+#define POSITION_ANNOUNCEMENT_ID (CHANNEL + 1)
+#define GRADIENT_ANNOUNCEMENT_ID (CHANNEL + 2)
+static struct announcement example_announcement;
+static struct announcement position_announcement;
+static struct announcement gradient_announcement;
 
 struct example_neighbor {
   struct example_neighbor *next;
   linkaddr_t addr;
   struct ctimer ctimer;
+  uint16_t energy;
+  struct position position;
+  bool has_position;
+  uint8_t gradient;
+  uint8_t cds_flags;
+  uint8_t num_nbrs;
+  linkaddr_t nbrs[CDS_MAX_LIST];
+  int16_t rssi;
+  clock_time_t last_heard;
 };
 
 #define NEIGHBOR_TIMEOUT 60 * CLOCK_SECOND
 #define MAX_NEIGHBORS 16
 LIST(neighbor_table);
 MEMB(neighbor_mem, struct example_neighbor, MAX_NEIGHBORS);
+
+/*
+ * Piggybacked neighbor discovery, enabled over serial with
+ * "piggyback on". A data packet received from a neighbor, or a unicast
+ * to a neighbor that the MAC layer saw acknowledged, refreshes the
+ * neighbor's table entry like an announcement does. While this node
+ * relays data its neighbors on the path keep its entry fresh the same
+ * way, so its own announcements are suppressed until PIGGYBACK_QUIET
+ * after the last packet it relayed. Sinks keep announcing.
+ *
+ * Only the transmissions are suppressed: the MAC send filter drops
+ * the broadcast announcements on ANNOUNCEMENT_CHANNEL. Our
+ * announcements stay registered, so those of the neighbors are still
+ * heard, and the broadcast announcement interval is left alone.
+ */
+#define PIGGYBACK_QUIET (NEIGHBOR_TIMEOUT / 2)
+#ifdef RIME_CONF_BROADCAST_ANNOUNCEMENT_CHANNEL
+#define ANNOUNCEMENT_CHANNEL RIME_CONF_BROADCAST_ANNOUNCEMENT_CHANNEL
+#else
+#define ANNOUNCEMENT_CHANNEL 2
+#endif
+static bool piggyback_enabled = false;
+static bool announcements_suppressed = false;
+static struct ctimer quiet_timer;
+static uint16_t piggyback_count = 0;
+static uint16_t suppressed_count = 0;
+
+/*
+ * Announcement gating for the energy-neutral controller. At a duty
+ * level below 100 the announcements are only sent for that share of
+ * every DUTY_GATE_PERIOD, so that fewer of them are sent while the node
+ * saves energy. Sinks keep announcing. Like the suppression above, the
+ * gate is the MAC send filter and the announcements stay registered.
+ */
+#define DUTY_GATE_PERIOD (60 * CLOCK_SECOND)
+static uint8_t duty_level = 100;
+static bool duty_gated = false;
+static struct ctimer duty_timer;
+
+/*
+ * What to do with a new neighbor when the table is full, set over serial
+ * with "evict none|rssi|oldest|energy". EVICT_NONE keeps the neighbors
+ * that were heard first. The others replace the entry with the weakest
+ * link (smoothed RSSI), the one heard from least recently, or the one
+ * with the lowest energy hint, if the new neighbor is better. Sinks are
+ * never evicted.
+ */
+enum evict_policy {
+  EVICT_NONE,
+  EVICT_RSSI,
+  EVICT_OLDEST,
+  EVICT_ENERGY,
+};
+static enum evict_policy evict_policy = EVICT_NONE;
+static uint16_t evicted_count = 0;
+static uint16_t rejected_count = 0;
+static uint16_t revisit_count = 0;
 /*---------------------------------------------------------------------------*/
 PROCESS(example_multihop_process, "multihop example");
 AUTOSTART_PROCESSES(&example_multihop_process);
 /*---------------------------------------------------------------------------*/
+static bool
+is_sink(void)
+{
+  uint8_t i;
+
+  if(tpwsn_is_sink()) {
+    return true;
+  }
+  for(i = 0; i < num_sinks; ++i) {
+    if(linkaddr_cmp(&linkaddr_node_addr, &sinks[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+/*---------------------------------------------------------------------------*/
+static void update_gradient(void);
+
+static void
+release_gradient(void *ptr)
+{
+  gradient_held = false;
+  update_gradient();
+}
+/*
+ * Recompute our hop distance to the nearest sink from the gradients advertised
+ * by our neighbors, and advertise it if it changed.
+ */
+static void
+update_gradient(void)
+{
+  struct example_neighbor *e;
+  uint8_t g = GRADIENT_MAX;
+
+  if(is_sink()) {
+    g = 0;
+    gradient_held = false;
+    ctimer_stop(&gradient_timer);
+  } else if(gradient_held) {
+    return;
+  } else {
+    for(e = list_head(neighbor_table); e != NULL; e = e->next) {
+      if(e->gradient < GRADIENT_MAX - 1 && e->gradient + 1 < g) {
+        g = e->gradient + 1;
+      }
+    }
+    if(g > gradient && gradient < GRADIENT_MAX) {
+      // Poison the route and hold it down
+      g = GRADIENT_MAX;
+      gradient_held = true;
+      ctimer_set(&gradient_timer, GRADIENT_HOLD, release_gradient, NULL);
+    }
+  }
+
+  if(g != gradient) {
+    gradient = g;
+    announcement_set_value(&gradient_announcement, gradient);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static bool
+has_neighbor(const struct example_neighbor *e, const linkaddr_t *addr)
+{
+  uint8_t i;
+
+  for(i = 0; i < e->num_nbrs; ++i) {
+    if(linkaddr_cmp(&e->nbrs[i], addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+/*
+ * The node ID of a Rime address, low byte first.
+ */
+static uint16_t
+node_number(const linkaddr_t *addr)
+{
+  return addr->u8[0] | (addr->u8[1] << 8);
+}
+/*
+ * Whether a marked neighbor with a higher ID than ours is a neighbor of
+ * all our other neighbors and of us (Wu-Li rule 1).
+ */
+static bool
+is_covered(void)
+{
+  struct example_neighbor *u, *w;
+
+  for(u = list_head(neighbor_table); u != NULL; u = u->next) {
+    if(!(u->cds_flags & CDS_MARKED) ||
+       node_number(&u->addr) <= node_number(&linkaddr_node_addr) ||
+       !has_neighbor(u, &linkaddr_node_addr)) {
+      continue;
+    }
+    for(w = list_head(neighbor_table); w != NULL; w = w->next) {
+      if(w != u && !has_neighbor(u, &w->addr)) {
+        break;
+      }
+    }
+    if(w == NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+/*
+ * Recompute whether this node is part of the backbone from the neighbor
+ * lists of its neighbors.
+ */
+static void
+update_backbone(void)
+{
+  struct example_neighbor *u, *v;
+  bool backbone;
+
+  cds_marked = false;
+  for(u = list_head(neighbor_table); u != NULL && !cds_marked; u = u->next) {
+    for(v = u->next; v != NULL; v = v->next) {
+      if(!has_neighbor(u, &v->addr) && !has_neighbor(v, &u->addr)) {
+        cds_marked = true;
+        break;
+      }
+    }
+  }
+
+  backbone = cds_marked && !is_covered();
+  if(backbone != cds_backbone) {
+    cds_backbone = backbone;
+    TLOG("%d.%d: backbone %d at %lu\n",
+         TLOG_I(linkaddr_node_addr.u8[0]), TLOG_I(linkaddr_node_addr.u8[1]),
+         TLOG_I(cds_backbone), TLOG_L(clock_time()));
+  }
+}
+/*---------------------------------------------------------------------------*/
 /*
  * This function is called by the ctimer present in each neighbor
  * table entry. The function removes the neighbor from the table
@@ -122,32 +498,91 @@ remove_neighbor(void *n)
 
   list_remove(neighbor_table, e);
   memb_free(&neighbor_mem, e);
+  update_gradient();
+  update_backbone();
 }
 /*---------------------------------------------------------------------------*/
 /*
- * This function is called when an incoming announcement arrives. The
- * function checks the neighbor table to see if the neighbor is
- * already present in the list. If the neighbor is not present in the
- * list, a new neighbor table entry is allocated and is added to the
- * neighbor table.
+ * Store the value of an announcement in the neighbor table entry,
+ * depending on which of our announcements it belongs to.
  */
 static void
-received_announcement(struct announcement *a,
-                      const linkaddr_t *from,
-		      uint16_t id, uint16_t value)
+update_neighbor(struct example_neighbor *e, uint16_t id, uint16_t value)
 {
-  struct example_neighbor *e;
+  switch(id) {
+  case ENERGY_ANNOUNCEMENT_ID:
+    e->energy = value;
+    break;
+  case POSITION_ANNOUNCEMENT_ID:
+    e->has_position = value != POSITION_UNKNOWN;
+    e->position.x = value >> 8;
+    e->position.y = value & 0xff;
+    break;
+  case GRADIENT_ANNOUNCEMENT_ID:
+    e->gradient = value > GRADIENT_MAX ? GRADIENT_MAX : value;
+    update_gradient();
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Make room in a full neighbor table for a neighbor we have just heard
+ * from, with the RSSI of its packet and, if the packet is its energy
+ * announcement, its energy hint. Returns true if an entry was freed.
+ */
+static bool
+evict_neighbor(int16_t rssi, uint16_t id, uint16_t value)
+{
+  struct example_neighbor *e, *victim = NULL;
 
-  /*  printf("Got announcement from %d.%d, id %d, value %d\n",
-      from->u8[0], from->u8[1], id, value);*/
+  for(e = list_head(neighbor_table); e != NULL; e = e->next) {
+    if(e->gradient == 0) {
+      continue;
+    }
+    if(victim == NULL ||
+       (evict_policy == EVICT_RSSI && e->rssi < victim->rssi) ||
+       (evict_policy == EVICT_OLDEST &&
+        (clock_time_t)(clock_time() - e->last_heard) >
+        (clock_time_t)(clock_time() - victim->last_heard)) ||
+       (evict_policy == EVICT_ENERGY && e->energy < victim->energy)) {
+      victim = e;
+    }
+  }
+
+  if(victim == NULL ||
+     evict_policy == EVICT_NONE ||
+     (evict_policy == EVICT_RSSI && rssi <= victim->rssi) ||
+     (evict_policy == EVICT_ENERGY &&
+      (id != ENERGY_ANNOUNCEMENT_ID || value <= victim->energy))) {
+    ++rejected_count;
+    return false;
+  }
+
+  ++evicted_count;
+  ctimer_stop(&victim->ctimer);
+  remove_neighbor(victim);
+  return true;
+}
+/*
+ * Find the neighbor table entry of a neighbor we have just heard from
+ * and refresh its timeout and link quality. If the neighbor is not
+ * present in the list, a new neighbor table entry is allocated and is
+ * added to the neighbor table. Returns NULL if the table is full. The
+ * announcement ID and value are those of the packet, if it is one.
+ */
+static struct example_neighbor *
+heard_neighbor(const linkaddr_t *from, uint16_t id, uint16_t value)
+{
+  struct example_neighbor *e;
+  int16_t rssi = (int16_t)packetbuf_attr(PACKETBUF_ATTR_RSSI);
 
-  /* We received an announcement from a neighbor so we need to update
-     the neighbor list, or add a new entry to the table. */
   for(e = list_head(neighbor_table); e != NULL; e = e->next) {
     if(linkaddr_cmp(from, &e->addr)) {
       /* Our neighbor was found, so we update the timeout. */
       ctimer_set(&e->ctimer, NEIGHBOR_TIMEOUT, remove_neighbor, e);
-      return;
+      e->rssi = (3 * e->rssi + rssi) / 4;
+      e->last_heard = clock_time();
+      return e;
     }
   }
 
@@ -155,14 +590,383 @@ received_announcement(struct announcement *a,
      allocating memory from the neighbor_mem pool, fill in the
      necessary fields, and add it to the list. */
   e = memb_alloc(&neighbor_mem);
+  if(e == NULL && evict_neighbor(rssi, id, value)) {
+    e = memb_alloc(&neighbor_mem);
+  }
   if(e != NULL) {
     linkaddr_copy(&e->addr, from);
+    e->energy = ENERGY_HINT_DEFAULT;
+    e->has_position = false;
+    e->gradient = GRADIENT_MAX;
+    e->cds_flags = 0;
+    e->num_nbrs = 0;
+    e->rssi = rssi;
+    e->last_heard = clock_time();
     list_add(neighbor_table, e);
     ctimer_set(&e->ctimer, NEIGHBOR_TIMEOUT, remove_neighbor, e);
+    update_backbone();
   }
+  return e;
 }
-static struct announcement example_announcement;
+/*
+ * This function is called when an incoming announcement arrives. The
+ * neighbor table entry of the sender is updated with the value it
+ * advertised.
+ */
+static void
+received_announcement(struct announcement *a,
+                      const linkaddr_t *from,
+		      uint16_t id, uint16_t value)
+{
+  struct example_neighbor *e;
+
+  /*  printf("Got announcement from %d.%d, id %d, value %d\n",
+      from->u8[0], from->u8[1], id, value);*/
+
+  /* We received an announcement from a neighbor so we need to update
+     the neighbor list, or add a new entry to the table. */
+  e = heard_neighbor(from, id, value);
+  if(e != NULL) {
+    update_neighbor(e, id, value);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Broadcast our neighbor list and backbone state, and schedule the next
+ * broadcast with some jitter.
+ */
+static struct broadcast_conn cds_broadcast;
+
+static void
+send_neighbor_list(void *ptr)
+{
+  struct neighbor_list msg;
+  struct example_neighbor *e;
+
+  msg.flags = (cds_marked ? CDS_MARKED : 0) | (cds_backbone ? CDS_BACKBONE : 0);
+  msg.count = 0;
+  for(e = list_head(neighbor_table); e != NULL && msg.count < CDS_MAX_LIST;
+      e = e->next) {
+    linkaddr_copy(&msg.ids[msg.count++], &e->addr);
+  }
+
+  packetbuf_copyfrom(&msg, 2 + msg.count * sizeof(linkaddr_t));
+  broadcast_send(&cds_broadcast);
+
+  ctimer_set(&cds_timer, CDS_INTERVAL / 2 + random_rand() % CDS_INTERVAL,
+             send_neighbor_list, NULL);
+}
+/*
+ * Store the neighbor list and backbone state broadcast by a neighbor.
+ */
+static void
+received_neighbor_list(struct broadcast_conn *c, const linkaddr_t *from)
+{
+  struct neighbor_list msg;
+  struct example_neighbor *e;
+  uint16_t len = packetbuf_datalen();
+
+  if(!cds_enabled || len < 2 || len > sizeof(msg)) {
+    return;
+  }
+  memcpy(&msg, packetbuf_dataptr(), len);
+  if(msg.count > (len - 2) / sizeof(linkaddr_t)) {
+    return;
+  }
+
+  e = heard_neighbor(from, 0, 0);
+  if(e != NULL) {
+    e->cds_flags = msg.flags;
+    e->num_nbrs = msg.count;
+    memcpy(e->nbrs, msg.ids, msg.count * sizeof(linkaddr_t));
+    update_backbone();
+  }
+}
+static const struct broadcast_callbacks cds_call = {received_neighbor_list, NULL};
 /*---------------------------------------------------------------------------*/
+/*
+ * Register our announcements and advertise our energy hint, position
+ * and gradient, this also starts sending out announcements.
+ */
+static void
+start_announcements(void)
+{
+  /* Register an announcement with the same announcement ID as the
+     Rime channel we use to open the multihop connection, and one
+     each for our position and our gradient. */
+  announcement_register(&example_announcement,
+			ENERGY_ANNOUNCEMENT_ID,
+			received_announcement);
+  announcement_register(&position_announcement,
+			POSITION_ANNOUNCEMENT_ID,
+			received_announcement);
+  announcement_register(&gradient_announcement,
+			GRADIENT_ANNOUNCEMENT_ID,
+			received_announcement);
+
+  announcement_set_value(&example_announcement, tpwsn_energy());
+  announcement_set_value(&position_announcement, has_position ?
+                         (position.x << 8) | position.y : POSITION_UNKNOWN);
+  announcement_set_value(&gradient_announcement, gradient);
+}
+/*
+ * Remove our announcements, which stops sending them out.
+ */
+static void
+stop_announcements(void)
+{
+  announcement_remove(&example_announcement);
+  announcement_remove(&position_announcement);
+  announcement_remove(&gradient_announcement);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * MAC send filter, drops our broadcast announcements while they are
+ * suppressed or the duty gate is closed.
+ */
+static bool
+announcement_filter(void)
+{
+  return !(announcements_suppressed || duty_gated) ||
+    packetbuf_attr(PACKETBUF_ATTR_CHANNEL) != ANNOUNCEMENT_CHANNEL;
+}
+static void
+resume_announcements(void *ptr)
+{
+  announcements_suppressed = false;
+  printf("%d.%d: announcements resumed at %lu\n",
+         linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
+         (unsigned long) clock_time());
+}
+/*
+ * Called whenever this node relays a data packet, suppresses our
+ * announcements until the data traffic stops.
+ */
+static void
+data_activity(void)
+{
+  if(!piggyback_enabled || is_sink()) {
+    return;
+  }
+  if(!announcements_suppressed) {
+    announcements_suppressed = true;
+    ++suppressed_count;
+    printf("%d.%d: announcements suppressed at %lu\n",
+           linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
+           (unsigned long) clock_time());
+  }
+  ctimer_set(&quiet_timer, PIGGYBACK_QUIET, resume_announcements, NULL);
+}
+/*
+ * Open or close the announcement gate, the gate stays open for
+ * duty_level percent of DUTY_GATE_PERIOD.
+ */
+static void
+duty_gate(void *ptr)
+{
+  duty_gated = !duty_gated;
+  if(duty_gated) {
+    ctimer_set(&duty_timer,
+               (uint32_t)DUTY_GATE_PERIOD * (100 - duty_level) / 100,
+               duty_gate, NULL);
+  } else {
+    ctimer_set(&duty_timer, (uint32_t)DUTY_GATE_PERIOD * duty_level / 100,
+               duty_gate, NULL);
+  }
+}
+static void
+start_duty_gate(void)
+{
+  ctimer_stop(&duty_timer);
+  if(duty_level < 100 && !is_sink()) {
+    // Start with an open gate
+    duty_gated = true;
+    duty_gate(NULL);
+  } else {
+    duty_gated = false;
+  }
+}
+/*
+ * Refresh the neighbor we received a data packet from.
+ */
+static void
+data_heard(const linkaddr_t *prevhop)
+{
+  if(piggyback_enabled && prevhop != NULL &&
+     heard_neighbor(prevhop, 0, 0) != NULL) {
+    ++piggyback_count;
+  }
+}
+/*
+ * Refresh the neighbor an acknowledged unicast was sent to. Only
+ * entries that are already in the table are refreshed, the packet
+ * buffer no longer holds anything about the link.
+ */
+static void
+mac_sent(const linkaddr_t *receiver, int status, int transmissions)
+{
+  struct example_neighbor *e;
+
+  if(!piggyback_enabled || status != MAC_TX_OK ||
+     linkaddr_cmp(receiver, &linkaddr_null)) {
+    return;
+  }
+  for(e = list_head(neighbor_table); e != NULL; e = e->next) {
+    if(linkaddr_cmp(receiver, &e->addr)) {
+      ctimer_set(&e->ctimer, NEIGHBOR_TIMEOUT, remove_neighbor, e);
+      e->last_heard = clock_time();
+      ++piggyback_count;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The count byte of the path record of the packet in the packet buffer,
+ * or NULL if it does not carry one.
+ */
+static uint8_t *
+path_record(void)
+{
+  uint8_t *data = packetbuf_dataptr();
+  uint16_t offset = DATA_BUF_SIZE + 1;
+
+  if(packetbuf_datalen() <= offset) {
+    return NULL;
+  }
+  if(data[DATA_BUF_SIZE] & EXT_BLOOM) {
+    offset += 1 + data[offset];
+  }
+  if(packetbuf_datalen() <= offset || !(data[DATA_BUF_SIZE] & EXT_PATH)) {
+    return NULL;
+  }
+  return data + offset;
+}
+/*
+ * The length byte of the Bloom filter of the packet in the packet
+ * buffer, or NULL if it does not carry one.
+ */
+static uint8_t *
+bloom_filter(void)
+{
+  uint8_t *data = packetbuf_dataptr();
+  uint16_t offset = DATA_BUF_SIZE + 1;
+
+  if(packetbuf_datalen() <= offset || !(data[DATA_BUF_SIZE] & EXT_BLOOM) ||
+     data[offset] == 0 || data[offset] > BLOOM_MAX ||
+     packetbuf_datalen() < offset + 1 + data[offset]) {
+    return NULL;
+  }
+  return data + offset;
+}
+/*
+ * The bit of a node ID for hash function i in a filter of bits bits.
+ */
+static uint8_t
+bloom_bit(uint8_t id, uint8_t i, uint8_t bits)
+{
+  static const uint8_t mul[BLOOM_HASHES] = { 167, 89 };
+  static const uint8_t add[BLOOM_HASHES] = { 13, 211 };
+
+  return ((uint16_t)id * mul[i] + add[i]) % bits;
+}
+
+static void
+bloom_add(uint8_t *filter, uint8_t id)
+{
+  uint8_t i, bit;
+
+  for(i = 0; i < BLOOM_HASHES; ++i) {
+    bit = bloom_bit(id, i, filter[0] * 8);
+    filter[1 + bit / 8] |= 1 << (bit % 8);
+  }
+}
+
+static bool
+bloom_contains(const uint8_t *filter, uint8_t id)
+{
+  uint8_t i, bit;
+
+  for(i = 0; i < BLOOM_HASHES; ++i) {
+    bit = bloom_bit(id, i, filter[0] * 8);
+    if(!(filter[1 + bit / 8] & (1 << (bit % 8)))) {
+      return false;
+    }
+  }
+  return true;
+}
+/*
+ * Append this node's entry to the path record of the packet in the
+ * packet buffer, if it carries one.
+ */
+static void
+record_hop(void)
+{
+  uint8_t *record = path_record();
+  uint8_t *entry;
+  uint8_t count;
+  clock_time_t now = clock_time();
+
+  if(record == NULL) {
+    return;
+  }
+  count = *record & ~PATH_OVERFLOW;
+  entry = record + 1 + count * PATH_ENTRY_SIZE;
+  if(count >= PATH_MAX ||
+     entry != (uint8_t *)packetbuf_dataptr() + packetbuf_datalen() ||
+     packetbuf_datalen() + PATH_ENTRY_SIZE > MAX_PAYLOAD) {
+    *record |= PATH_OVERFLOW;
+    return;
+  }
+
+  entry[0] = linkaddr_node_addr.u8[0];
+  entry[1] = now & 0xff;
+  entry[2] = (now >> 8) & 0xff;
+  *record = (*record & PATH_OVERFLOW) | (count + 1);
+  packetbuf_set_datalen(packetbuf_datalen() + PATH_ENTRY_SIZE);
+}
+/*
+ * Print the path record of the packet in the packet buffer as
+ * "<id>@<time>" entries, in the order the nodes relayed the packet.
+ */
+static void
+print_path(const linkaddr_t *originator)
+{
+  uint8_t *record = path_record();
+  uint8_t *entry;
+  uint8_t i, count;
+
+  if(record == NULL) {
+    return;
+  }
+  count = *record & ~PATH_OVERFLOW;
+  printf("path %d.%d from %d.%d entries %u overflow %d:",
+         linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
+         originator->u8[0], originator->u8[1], count,
+         (*record & PATH_OVERFLOW) != 0);
+  for(i = 0, entry = record + 1; i < count; ++i, entry += PATH_ENTRY_SIZE) {
+    printf(" %u@%u", entry[0], entry[1] | (entry[2] << 8));
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Deliver the message in the packet buffer at this sink.
+ */
+static void
+deliver(const linkaddr_t *originator, uint8_t hops)
+{
+  ++delivered_count;
+
+  TLOG("sink %d.%d received '%s' from %d.%d at %lu, hops %d\n",
+       TLOG_I(linkaddr_node_addr.u8[0]), TLOG_I(linkaddr_node_addr.u8[1]),
+       TLOG_S(packetbuf_dataptr()),
+       TLOG_I(originator->u8[0]), TLOG_I(originator->u8[1]),
+       TLOG_L(clock_time()), TLOG_I(hops));
+
+  record_hop();
+  print_path(originator);
+}
 /*
  * This function is called at the final recepient of the message.
  */
@@ -171,165 +975,606 @@ recv(struct multihop_conn *c, const linkaddr_t *sender,
      const linkaddr_t *prevhop,
      uint8_t hops)
 {
-  // Store the data locally for coverage metrics
-  memcpy(data_buf, packetbuf_dataptr(), DATA_BUF_SIZE);
+  data_heard(prevhop);
+  tpwsn_rx(packetbuf_dataptr(), packetbuf_datalen());
+  deliver(sender, hops);
+}
+/*
+ * Whether forward() may relay to a neighbor. While restrict_backbone is
+ * set only backbone neighbors and sinks (which advertise a gradient of
+ * 0) are eligible, and while visited is set only neighbors that are not
+ * in that Bloom filter.
+ */
+static bool restrict_backbone = false;
+static const uint8_t *visited = NULL;
 
-  printf("sink received '%s'\n", (char *)packetbuf_dataptr());
+static bool
+eligible(const struct example_neighbor *n)
+{
+  uint8_t i;
+
+  if(visited != NULL && bloom_contains(visited, n->addr.u8[0])) {
+    return false;
+  }
+  if(!restrict_backbone || (n->cds_flags & CDS_BACKBONE) || n->gradient == 0) {
+    return true;
+  }
+  for(i = 0; i < num_sinks; ++i) {
+    if(linkaddr_cmp(&n->addr, &sinks[i])) {
+      return true;
+    }
+  }
+  return false;
 }
+/*
+ * Pick the index of an eligible neighbor uniformly at random, or -1 if
+ * there is none.
+ */
+static int
+uniform_index(void)
+{
+  struct example_neighbor *n;
+  int i, r, count = 0;
+
+  for(n = list_head(neighbor_table); n != NULL; n = n->next) {
+    count += eligible(n);
+  }
+  if(count == 0) {
+    return -1;
+  }
+
+  r = random_rand() % count;
+  for(n = list_head(neighbor_table), i = 0; n != NULL; n = n->next, ++i) {
+    if(eligible(n) && r-- == 0) {
+      break;
+    }
+  }
+  return i;
+}
+/*
+ * Pick the index of a neighbor with probability proportional to its
+ * advertised energy hint. Every neighbor gets a weight of at least one
+ * so that nodes which have not advertised a hint can still be chosen.
+ */
+static uint32_t
+energy_weight(const struct example_neighbor *n)
+{
+  return eligible(n) ? (uint32_t)n->energy + 1 : 0;
+}
+
+static int
+energy_weighted_index(void)
+{
+  struct example_neighbor *n;
+  uint32_t total = 0;
+  uint32_t r;
+  int i;
+
+  for(n = list_head(neighbor_table); n != NULL; n = n->next) {
+    total += energy_weight(n);
+  }
+  if(total == 0) {
+    return -1;
+  }
+
+  r = (((uint32_t)random_rand() << 16) | random_rand()) % total;
+  for(n = list_head(neighbor_table), i = 0; n != NULL; n = n->next, ++i) {
+    if(r < energy_weight(n)) {
+      break;
+    }
+    r -= energy_weight(n);
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+distance2(const struct position *a, const struct position *b)
+{
+  int32_t dx = (int32_t)a->x - b->x;
+  int32_t dy = (int32_t)a->y - b->y;
+
+  return dx * dx + dy * dy;
+}
+/*
+ * Pick the index of the neighbor that is closest to the destination,
+ * or -1 if no neighbor is closer to it than we are.
+ */
+static int
+geographic_index(void)
+{
+  struct example_neighbor *n;
+  uint32_t best, d;
+  int i, num = -1;
+
+  if(!has_position || !has_dest_position) {
+    return -1;
+  }
+
+  best = distance2(&position, &dest_position);
+  for(n = list_head(neighbor_table), i = 0; n != NULL; n = n->next, ++i) {
+    if(n->has_position && eligible(n)) {
+      d = distance2(&n->position, &dest_position);
+      if(d < best) {
+        best = d;
+        num = i;
+      }
+    }
+  }
+  return num;
+}
+/*
+ * Pick the index of the neighbor with the lowest hop distance to the
+ * sink, or -1 if no neighbor is closer to it than we are.
+ */
+static int
+gradient_index(void)
+{
+  struct example_neighbor *n;
+  uint8_t best = gradient;
+  int i, num = -1;
+
+  for(n = list_head(neighbor_table), i = 0; n != NULL; n = n->next, ++i) {
+    if(n->gradient < best && eligible(n)) {
+      best = n->gradient;
+      num = i;
+    }
+  }
+  return num;
+}
+/*---------------------------------------------------------------------------*/
 /*
  * This function is called to forward a packet. The function picks a
- * random neighbor from the neighbor list and returns its address. The
- * multihop layer sends the packet to this address. If no neighbor is
- * found, the function returns NULL to signal to the multihop layer
- * that the packet should be dropped.
+ * neighbor from the neighbor list according to forward_policy and
+ * returns its address. The multihop layer sends the packet to this
+ * address. If no neighbor is found, the function returns NULL to
+ * signal to the multihop layer that the packet should be dropped.
  */
 static linkaddr_t *
 forward(struct multihop_conn *c,
 	const linkaddr_t *originator, const linkaddr_t *dest,
 	const linkaddr_t *prevhop, uint8_t hops)
 {
-  printf("multihop message received '%s'\n", (char *)packetbuf_dataptr());
+  TLOG("multihop message received '%s'\n", TLOG_S(packetbuf_dataptr()));
   
   /* Find a random neighbor to send to. */
   int num, i;
   struct example_neighbor *n;
+  uint8_t *filter;
 
   // Store the data locally for coverage metrics
-  memcpy(data_buf, packetbuf_dataptr(), DATA_BUF_SIZE);
+  data_heard(prevhop);
+  tpwsn_rx(packetbuf_dataptr(), packetbuf_datalen());
+
+  /* Any sink the packet reaches delivers it, regardless of which sink
+     it was addressed to. */
+  if(is_sink()) {
+    deliver(originator, hops);
+    return NULL;
+  }
 
-  if(list_length(neighbor_table) > 0) {
-    num = random_rand() % list_length(neighbor_table);
+  if(list_length(neighbor_table) > 0 && tpwsn_tx()) {
+    /* On the backbone, relay only through backbone neighbors, or
+       through any neighbor if none of them is on the backbone */
+    restrict_backbone = cds_enabled;
+    if(restrict_backbone && uniform_index() < 0) {
+      restrict_backbone = false;
+    }
+
+    /* Prefer neighbors that have not relayed the packet yet, and mark
+       this node as visited */
+    filter = bloom_filter();
+    if(filter != NULL) {
+      bloom_add(filter, linkaddr_node_addr.u8[0]);
+      visited = filter;
+      if(uniform_index() < 0) {
+        visited = NULL;
+        ++revisit_count;
+      }
+    }
+
+    switch(forward_policy) {
+    case FORWARD_ENERGY:
+      num = energy_weighted_index();
+      break;
+    case FORWARD_GEO:
+      num = geographic_index();
+      break;
+    case FORWARD_GRADIENT:
+      num = gradient_index();
+      break;
+    default:
+      num = -1;
+      break;
+    }
+    if(num < 0) {
+      num = uniform_index();
+    }
+    visited = NULL;
     i = 0;
     for(n = list_head(neighbor_table); n != NULL && i != num; n = n->next) {
       ++i;
     }
     if(n != NULL) {
-      printf("%d.%d: Forwarding packet to %d.%d (%d in list), hops %d\n",
-	     linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
-	     n->addr.u8[0], n->addr.u8[1], num,
-	     packetbuf_attr(PACKETBUF_ATTR_HOPS));
+      data_activity();
+      record_hop();
+      TLOG("%d.%d: Forwarding packet to %d.%d (%d in list), hops %d, energy %u, rssi %d\n",
+	   TLOG_I(linkaddr_node_addr.u8[0]), TLOG_I(linkaddr_node_addr.u8[1]),
+	   TLOG_I(n->addr.u8[0]), TLOG_I(n->addr.u8[1]), TLOG_I(num),
+	   TLOG_I(packetbuf_attr(PACKETBUF_ATTR_HOPS)), TLOG_I(n->energy),
+	   TLOG_I(n->rssi));
+      ++forwarded_count;
       return &n->addr;
     }
   }
-  printf("%d.%d: did not find a neighbor to foward to\n",
-	 linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+  TLOG("%d.%d: did not find a neighbor to foward to\n",
+       TLOG_I(linkaddr_node_addr.u8[0]), TLOG_I(linkaddr_node_addr.u8[1]));
+  ++dropped_count;
   return NULL;
 }
 static const struct multihop_callbacks multihop_call = {recv, forward};
 static struct multihop_conn multihop;
 /*---------------------------------------------------------------------------*/
 static void
-reset(long restart_delay) {
-  if(list_length(neighbor_table) > 0) {
-    struct example_neighbor *e;
-
-    // Stop all callback timers
-    for (e = list_head(neighbor_table); e != NULL; e = e->next) {
-      ctimer_stop(&e->ctimer);
-    }
-
-    // Chop items from the list
-    int table_length = list_length(neighbor_table);
-    while(table_length > 0) {
-      list_chop(neighbor_table);
-      table_length = list_length(neighbor_table);
-    }
-
-    // Close the multicast conneciton
-    multihop_close(&multihop);
+collect_recv(struct broadcast_conn *c, const linkaddr_t *from)
+{
+  tpwsn_collect_input(packetbuf_dataptr(), packetbuf_datalen());
+}
+static const struct broadcast_callbacks collect_call = {collect_recv, NULL};
+static struct broadcast_conn collect_broadcast;
 
-    // Remove the RIME announcement
-    announcement_remove(&example_announcement);
+static void
+collect_send(const void *data, uint16_t len)
+{
+  packetbuf_copyfrom(data, len);
+  broadcast_send(&collect_broadcast);
+}
+/*---------------------------------------------------------------------------*/
+static void
+open_connections(void)
+{
+  /* Initialize the memory for the neighbor table entries. */
+  memb_init(&neighbor_mem);
 
-    // Reset the packet buffer
-    packetbuf_clear();
+  /* Initialize the list used for the neighbor table. */
+  list_init(neighbor_table);
 
-    // Clear the message on this mote
-    data_buf = NULL;
+  /* Open a multihop connection on Rime channel CHANNEL. */
+  multihop_open(&multihop, CHANNEL, &multihop_call);
 
-    // Turn off the radio stack
-    NETSTACK_RADIO.off();
+  /* Advertise our energy hint, position and gradient. */
+  gradient = GRADIENT_MAX;
+  gradient_held = false;
+  update_gradient();
+  start_announcements();
+  start_duty_gate();
 
-    // Set the timer to reset and announce
-    reset_scheduled = true;
-    printf("%d.%d: Crashing mote, restart in %ld seconds\n", 
-      linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], restart_delay);
-    etimer_set(&rt, (restart_delay * CLOCK_SECOND));
+  /* Exchange neighbor lists to rebuild the backbone. */
+  broadcast_open(&cds_broadcast, CDS_CHANNEL, &cds_call);
+  if(cds_enabled) {
+    ctimer_set(&cds_timer, random_rand() % CDS_INTERVAL,
+               send_neighbor_list, NULL);
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
-initialise(void) {
+rmh_init(void)
+{
   // Initialise the data buffer
   data_buf = (char *) malloc(DATA_BUF_SIZE * sizeof(char));
-  
-  /* Initialize the memory for the neighbor table entries. */
-  memb_init(&neighbor_mem);
+  memset(data_buf, 0, DATA_BUF_SIZE);
 
-  /* Initialize the list used for the neighbor table. */
-  list_init(neighbor_table);
+  // The coverage summaries stay open across power losses, the harness
+  // stops them while the node is down
+  broadcast_open(&collect_broadcast, COLLECT_CHANNEL, &collect_call);
+  tpwsn_collect_open(collect_send);
 
-  /* Open a multihop connection on Rime channel CHANNEL. */
-  multihop_open(&multihop, CHANNEL, &multihop_call);
+  // Acknowledged unicasts refresh the neighbor table, and our
+  // announcements are suppressed at the MAC
+  tpwsn_mac_set_sent_hook(mac_sent);
+  tpwsn_mac_set_send_filter(announcement_filter);
 
-  /* Register an announcement with the same announcement ID as the
-     Rime channel we use to open the multihop connection above. */
-  announcement_register(&example_announcement,
-			CHANNEL,
-			received_announcement);
+  open_connections();
+}
+/*---------------------------------------------------------------------------*/
+static void
+rmh_on_sleep(void)
+{
+  struct example_neighbor *e;
+
+  // Stop all callback timers
+  for(e = list_head(neighbor_table); e != NULL; e = e->next) {
+    ctimer_stop(&e->ctimer);
+  }
+
+  // Chop items from the list
+  while(list_length(neighbor_table) > 0) {
+    list_chop(neighbor_table);
+  }
+
+  // Close the multicast conneciton
+  multihop_close(&multihop);
+
+  // Forget the route to the sinks
+  ctimer_stop(&gradient_timer);
+  gradient_held = false;
+
+  // Leave the backbone
+  ctimer_stop(&cds_timer);
+  broadcast_close(&cds_broadcast);
+  cds_marked = cds_backbone = false;
+
+  // Remove the RIME announcements
+  ctimer_stop(&quiet_timer);
+  ctimer_stop(&duty_timer);
+  announcements_suppressed = false;
+  duty_gated = false;
+  stop_announcements();
 
-  /* Set a dummy value to start sending out announcments. */
-  announcement_set_value(&example_announcement, 0);
+  // Reset the packet buffer
+  packetbuf_clear();
+
+  // Clear the message on this mote
+  memset(data_buf, 0, DATA_BUF_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rmh_on_rx(const void *data, uint16_t len)
+{
+  memcpy(data_buf, data, len < DATA_BUF_SIZE ? len : DATA_BUF_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rmh_coverage_state(void)
+{
+  return data_buf[0] != '\0';
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The experiment scripts expect the message itself.
+ */
+static void
+rmh_print(void)
+{
+  printf("Current token: %.*s\n", DATA_BUF_SIZE, data_buf);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Print the delivery counters of this node. The gradient is included
+ * so that the energy of the nodes around each sink can be told apart
+ * from the rest of the network, and the neighbor table occupancy shows
+ * how much of the neighbor_mem pool is in use.
+ */
+static void
+rmh_stats(void)
+{
+  printf("%d.%d: rmh sink %d gradient %u delivered %u forwarded %u dropped %u "
+         "neighbors %d/%d evicted %u rejected %u backbone %d revisits %u "
+         "piggyback %u suppressed %u\n",
+         linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], is_sink(),
+         gradient, delivered_count, forwarded_count, dropped_count,
+         list_length(neighbor_table), MAX_NEIGHBORS, evicted_count,
+         rejected_count, cds_backbone, revisit_count, piggyback_count,
+         suppressed_count);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rmh_on_energy(uint16_t level)
+{
+  announcement_set_value(&example_announcement, level);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rmh_on_duty(uint8_t duty)
+{
+  duty_level = duty;
+  if(tpwsn_is_up()) {
+    start_duty_gate();
+  }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Replace the sinks with the list parsed by "sinks", unless it is empty.
+ */
 static void
-restart_node(void) {
-  etimer_stop(&rt);
-  reset_scheduled = false;
-  NETSTACK_RADIO.on();
-  initialise();
+set_sinks(void)
+{
+  uint8_t i;
+
+  if(num_new_sinks == 0) {
+    printf("No valid sink IDs, keeping %d sinks\n", num_sinks);
+    return;
+  }
+  memcpy(sinks, new_sinks, sizeof(sinks[0]) * num_new_sinks);
+  num_sinks = num_new_sinks;
+  for(i = 0; i < num_sinks; ++i) {
+    printf("Adding sink %d.%d\n", sinks[i].u8[0], sinks[i].u8[1]);
+  }
+  update_gradient();
 }
 /*---------------------------------------------------------------------------*/
 static void
-serial_handler(char *data) {
-  char *ptr = strtok(data, " ");
+rmh_command(char *ptr)
+{
+  static enum {
+    EXPECT_COMMAND,
+    EXPECT_FORWARD,
+    EXPECT_POS_X,
+    EXPECT_POS_Y,
+    EXPECT_DEST_X,
+    EXPECT_DEST_Y,
+    EXPECT_SINKS,
+    EXPECT_CDS,
+    EXPECT_EVICT,
+    EXPECT_PATH,
+    EXPECT_BLOOM,
+    EXPECT_PIGGYBACK,
+  } expect = EXPECT_COMMAND;
   char *endptr;
-  long delay = 0;
-  bool seen_sleep = false;
-  bool seen_print = false;
-
-  // Iterate over the tokenised string
-  while (ptr != NULL) {
-    // Parse serial input for restarting a node
-    if (strcmp(ptr, "sleep") == 0) {
-      seen_sleep = true;
+  long value;
+
+  // The end of the line terminates any argument list
+  if(ptr == NULL) {
+    if(expect == EXPECT_SINKS) {
+      set_sinks();
+    }
+    expect = EXPECT_COMMAND;
+    return;
+  }
+
+  value = strtol(ptr, &endptr, 10);
+
+  switch(expect) {
+  case EXPECT_FORWARD:
+    // Parse serial input to select the next-hop selection policy
+    if(strcmp(ptr, "energy") == 0) {
+      forward_policy = FORWARD_ENERGY;
+    } else if(strcmp(ptr, "geo") == 0) {
+      forward_policy = FORWARD_GEO;
+    } else if(strcmp(ptr, "gradient") == 0) {
+      forward_policy = FORWARD_GRADIENT;
+    } else {
+      forward_policy = FORWARD_UNIFORM;
+    }
+    printf("Setting forward policy to %s\n", ptr);
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_EVICT:
+    // Parse serial input to select the neighbor eviction policy
+    if(strcmp(ptr, "rssi") == 0) {
+      evict_policy = EVICT_RSSI;
+    } else if(strcmp(ptr, "oldest") == 0) {
+      evict_policy = EVICT_OLDEST;
+    } else if(strcmp(ptr, "energy") == 0) {
+      evict_policy = EVICT_ENERGY;
+    } else {
+      evict_policy = EVICT_NONE;
     }
-    if (seen_sleep) {
-      delay = strtol(ptr, &endptr, 10);
+    printf("Setting eviction policy to %s\n", ptr);
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_PIGGYBACK:
+    // Parse serial input to refresh neighbors from data traffic
+    piggyback_enabled = strcmp(ptr, "on") == 0;
+    printf("Setting piggybacked discovery %s\n",
+           piggyback_enabled ? "on" : "off");
+    if(!piggyback_enabled && announcements_suppressed) {
+      ctimer_stop(&quiet_timer);
+      resume_announcements(NULL);
     }
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_BLOOM:
+    // Parse serial input to set the Bloom filter size of originated packets
+    bloom_len = value < 0 ? 0 : (value > BLOOM_MAX ? BLOOM_MAX : value);
+    printf("Setting Bloom filter to %u bytes\n", bloom_len);
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_PATH:
+    // Parse serial input to record the path of originated packets
+    path_enabled = strcmp(ptr, "on") == 0;
+    printf("Setting path recording %s\n", path_enabled ? "on" : "off");
+    expect = EXPECT_COMMAND;
+    return;
 
-    // Parse serial input to output the current token of the node
-    if (strcmp(ptr, "print") == 0) {
-        printf("Seen print\n");
-        seen_print = true;
+  case EXPECT_CDS:
+    // Parse serial input to enable the backbone
+    cds_enabled = strcmp(ptr, "on") == 0;
+    printf("Setting backbone %s\n", cds_enabled ? "on" : "off");
+    ctimer_stop(&cds_timer);
+    if(cds_enabled && tpwsn_is_up()) {
+      ctimer_set(&cds_timer, random_rand() % CDS_INTERVAL,
+                 send_neighbor_list, NULL);
     }
-    if (seen_print) {
-      printf("Current token: %s\n", data_buf);
-      NETSTACK_RADIO.off();
-      multihop_close(&multihop);
-      announcement_remove(&example_announcement);
-      broadcast_announcement_stop();
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_POS_X:
+    // Parse serial input to set the coordinates of this node
+    position.x = value;
+    expect = EXPECT_POS_Y;
+    return;
+
+  case EXPECT_POS_Y:
+    position.y = value;
+    has_position = true;
+    announcement_set_value(&position_announcement,
+                           (position.x << 8) | position.y);
+    printf("Setting position to (%u, %u)\n", position.x, position.y);
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_DEST_X:
+    // Parse serial input to set the coordinates of the sink
+    dest_position.x = value;
+    expect = EXPECT_DEST_Y;
+    return;
+
+  case EXPECT_DEST_Y:
+    dest_position.y = value;
+    has_dest_position = true;
+    printf("Setting destination position to (%u, %u)\n",
+           dest_position.x, dest_position.y);
+    expect = EXPECT_COMMAND;
+    return;
+
+  case EXPECT_SINKS:
+    // Parse serial input to set the list of sinks
+    if(endptr != ptr && value > 0) {
+      if(num_new_sinks < MAX_SINKS) {
+        new_sinks[num_new_sinks].u8[0] = value & 0xff;
+        new_sinks[num_new_sinks].u8[1] = (value >> 8) & 0xff;
+        ++num_new_sinks;
+      }
+      return;
     }
+    set_sinks();
+    expect = EXPECT_COMMAND;
+    break;
 
-    ptr = strtok(NULL, " ");
+  default:
+    break;
   }
 
-  // If the mote has been told to sleep then it can sleep
-  if (seen_sleep && delay > 0) {
-    reset(delay);
+  if(strcmp(ptr, "forward") == 0) {
+    expect = EXPECT_FORWARD;
+  } else if(strcmp(ptr, "pos") == 0) {
+    expect = EXPECT_POS_X;
+  } else if(strcmp(ptr, "dest") == 0) {
+    expect = EXPECT_DEST_X;
+  } else if(strcmp(ptr, "piggyback") == 0) {
+    expect = EXPECT_PIGGYBACK;
+  } else if(strcmp(ptr, "bloom") == 0) {
+    expect = EXPECT_BLOOM;
+  } else if(strcmp(ptr, "path") == 0) {
+    expect = EXPECT_PATH;
+  } else if(strcmp(ptr, "evict") == 0) {
+    expect = EXPECT_EVICT;
+  } else if(strcmp(ptr, "cds") == 0) {
+    expect = EXPECT_CDS;
+  } else if(strcmp(ptr, "sinks") == 0) {
+    expect = EXPECT_SINKS;
+    num_new_sinks = 0;
   }
 }
 /*---------------------------------------------------------------------------*/
+static const struct tpwsn_protocol rmh_protocol = {
+  "rmh",
+  rmh_init,
+  rmh_on_sleep,
+  open_connections,
+  rmh_on_rx,
+  rmh_coverage_state,
+  rmh_stats,
+  rmh_command,
+  rmh_on_energy,
+  rmh_on_duty,
+  rmh_print,
+};
+/*---------------------------------------------------------------------------*/
 /**
  * TODO:
  * - Modify broadcast-announcement.c and rime.c to make announcement period configurable
@@ -341,11 +1586,8 @@ PROCESS_THREAD(example_multihop_process, ev, data)
     
   PROCESS_BEGIN();
 
-  // Init the network stack
-  initialise();
-
-  // Initialise the serial line
-  serial_line_init();
+  // Init the harness, the serial line and the network stack
+  tpwsn_init(&rmh_protocol);
 
   /* Activate the button sensor. We use the button to drive traffic -
      when the button is pressed, a packet is sent. */
@@ -354,28 +1596,47 @@ PROCESS_THREAD(example_multihop_process, ev, data)
   /* Loop forever, send a packet when the button is pressed. */
   while(1) {
     linkaddr_t to;
+    uint8_t *msg;
+    uint16_t len;
 
     PROCESS_YIELD();
 
     if (ev == sensors_event && data == &button_sensor) {
-      printf("Button pressed, starting RMH bcast\n");
-      /* Copy the "Hello" to the packet buffer. */
+      if (!tpwsn_tx()) {
+        continue;
+      }
+
+      printf("Button pressed, starting RMH bcast at %lu\n",
+             (unsigned long) clock_time());
+      /* Copy the "Hello" to the packet buffer, followed by an empty
+         Bloom filter and path record if they are enabled. The
+         multihop layer calls forward() for the first hop, which
+         fills them in. */
       packetbuf_copyfrom("hello", DATA_BUF_SIZE);
+      if(bloom_len > 0 || path_enabled) {
+        msg = packetbuf_dataptr();
+        len = DATA_BUF_SIZE;
+        msg[len++] = (bloom_len > 0 ? EXT_BLOOM : 0) |
+                     (path_enabled ? EXT_PATH : 0);
+        if(bloom_len > 0) {
+          msg[len++] = bloom_len;
+          memset(msg + len, 0, bloom_len);
+          len += bloom_len;
+        }
+        if(path_enabled) {
+          msg[len++] = 0;
+        }
+        packetbuf_set_datalen(len);
+      }
 
-      /* Set the Rime address of the final receiver of the packet to
-         1.0. This is a value that happens to work nicely in a Cooja
-         simulation (because the default simulation setup creates one
-         node with address 1.0). */
-      to.u8[0] = 1;
-      to.u8[1] = 0;
+      /* Address the packet to the first sink, any other sink on the
+         way delivers it too. */
+      linkaddr_copy(&to, &sinks[0]);
 
       /* Send the packet. */
       multihop_send(&multihop, &to);
-    } else if (ev == serial_line_event_message && data != NULL) {
-      serial_handler(data);
-    } else if (etimer_expired(&rt) && reset_scheduled) {
-      printf("Restarting node at time %lu\n", (unsigned long) clock_time());
-      restart_node();
+    } else {
+      tpwsn_event(ev, data);
     }
   }
 
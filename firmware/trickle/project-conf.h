@@ -0,0 +1,62 @@
+/**
+ * \file
+ *         Contiki-NG configuration of the Trickle firmware.
+ *
+ *         The firmware only exchanges a one byte token over link-local
+ *         UDP multicast, so with TPWSN_CONF_MINIMAL_NET (the default)
+ *         the IPv6 stack is trimmed to what that needs: no TCP, no
+ *         fragmentation, no neighbour discovery traffic, no routes and
+ *         small buffers. RPL can only be removed from the Makefile,
+ *         which selects MAKE_ROUTING_NULLROUTING and sets this option
+ *         from its MINIMAL_NET variable.
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+/* Energest is needed for the energy figures printed by "stats" */
+#define ENERGEST_CONF_ON 1
+
+/* The harness MAC wrapper needs to know which driver API it wraps */
+#define TPWSN_CONF_CONTIKI_NG 1
+
+/* Run CSMA under the harness MAC wrapper, with the backoff exponents
+   and the number of backoffs read from variables set over serial */
+#define NETSTACK_CONF_MAC           tpwsn_mac_driver
+#define CSMA_CONF_MIN_BE            tpwsn_mac_min_be
+#define CSMA_CONF_MAX_BE            tpwsn_mac_max_be
+#define CSMA_CONF_MAX_BACKOFF       tpwsn_mac_max_backoff
+#ifndef __ASSEMBLER__
+extern unsigned char tpwsn_mac_min_be;
+extern unsigned char tpwsn_mac_max_be;
+extern unsigned char tpwsn_mac_max_backoff;
+#endif
+
+#ifndef TPWSN_CONF_MINIMAL_NET
+#define TPWSN_CONF_MINIMAL_NET 1
+#endif
+
+#if TPWSN_CONF_MINIMAL_NET
+
+/* UDP only, with one connection for the tokens and one for the
+   coverage summaries */
+#define UIP_CONF_TCP                0
+#define UIP_CONF_UDP_CONNS          2
+
+/* A token datagram is 49 bytes, so no fragmentation and small buffers */
+#define SICSLOWPAN_CONF_FRAG        0
+#define UIP_CONF_BUFFER_SIZE        160
+#define QUEUEBUF_CONF_NUM           4
+
+/* Link-local multicast needs neither routes nor neighbour discovery */
+#define UIP_CONF_MAX_ROUTES         0
+#define NBR_TABLE_CONF_MAX_NEIGHBORS 4
+#define UIP_CONF_ND6_SEND_RA        0
+#define UIP_CONF_ND6_SEND_NS        0
+#define UIP_CONF_ND6_SEND_NA        0
+#define UIP_CONF_IPV6_QUEUE_PKT     0
+#define UIP_CONF_ROUTER             0
+
+#endif /* TPWSN_CONF_MINIMAL_NET */
+
+#endif /* PROJECT_CONF_H_ */
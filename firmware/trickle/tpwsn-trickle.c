@@ -35,12 +35,12 @@
 #include "contiki-lib.h"
 #include "contiki-net.h"
 
-#include "dev/serial-line.h"
-#include "dev/leds.h"
-
 #include "lib/trickle-timer.h"
 #include "lib/random.h"
 
+#include "tpwsn.h"
+#include "tpwsn-collect.h"
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -58,17 +58,18 @@
 static struct trickle_timer tt;
 static long imin = 16;
 static long imax = 10;
+
+/* Doublings of Imin applied for the energy-neutral duty level */
+static uint8_t duty_shift = 0;
 static long redundancy_const = 2;
 static long msg_limit = 1;
 
 /* Networking */
 #define TRICKLE_PROTO_PORT 30001
+#define COLLECT_PORT 30002
 static struct uip_udp_conn *trickle_conn;
+static struct uip_udp_conn *collect_conn;  /* coverage summaries */
 static uip_ipaddr_t ipaddr;     /* destination: link-local all-nodes multicast */
-static bool suppress_trickle = false;
-static bool is_source = false;
-static bool is_sink = false;
-static bool reset_scheduled = false;
 
 /*
  * For this 'protocol', nodes exchange a token (1 byte) at a frequency
@@ -87,49 +88,99 @@ static bool reset_scheduled = false;
 #define NEW_TOKEN_PROB      2
 static uint8_t token;
 static struct etimer et; /* Used to periodically generate inconsistencies */
-static struct etimer rt; /* Used to 'restart' the node  */
+
+/*
+ * Source updates arriving within coalesce_ms of the first pending one are
+ * merged into a single token increment, and so a single trickle reset.
+ * With coalesce_ms == 0 every update increments the token straight away.
+ * "burst <n> <ms>" injects n updates, one every ms, to drive bursty
+ * workloads.
+ */
+static long coalesce_ms = 0;
+static struct ctimer coalesce_timer;
+static uint16_t pending_updates = 0;
+static uint16_t update_count = 0;
+static uint16_t version_count = 0;
+static struct ctimer burst_timer;
+static long burst_left = 0;
+static long burst_ms = 0;
+
+/*
+ * A leaf only listens: it updates its token from what it hears but never
+ * transmits, so it never counts towards the redundancy of its neighbours
+ * either. The role is set over serial with "leaf on|off", or with
+ * "leaf auto <level>" the node is a leaf while the harness energy level
+ * is below <level>. Sources are never leaves.
+ */
+static enum {
+    LEAF_OFF,
+    LEAF_ON,
+    LEAF_AUTO,
+} leaf_mode = LEAF_OFF;
+static long leaf_threshold = 0;
+static uint16_t leaf_skipped = 0;
 /*---------------------------------------------------------------------------*/
 PROCESS(trickle_protocol_process, "Trickle Protocol process");
 AUTOSTART_PROCESSES(&trickle_protocol_process);
 
+/*---------------------------------------------------------------------------*/
+static bool
+is_leaf(void) {
+    if (tpwsn_is_source()) {
+        return false;
+    }
+    return leaf_mode == LEAF_ON ||
+           (leaf_mode == LEAF_AUTO && tpwsn_energy() < leaf_threshold);
+}
+
 /*---------------------------------------------------------------------------*/
 static void
-tcpip_handler(void) {
-    if (uip_newdata()) {
-        if (is_sink) {
-            // Print out that the sink received a token at time
-            LOG_INFO("Sink recv'd at %lu (I=%lu, c=%u): ",
-                     (unsigned long) clock_time(), (unsigned long) tt.i_cur, tt.c);
-            LOG_INFO("Our token=0x%02x, theirs=0x%02x\n", token,
-                     ((uint8_t *) uip_appdata)[0]);
+trickle_on_rx(const void *data, uint16_t len) {
+    uint8_t theirs = ((const uint8_t *) data)[0];
+
+    if (tpwsn_is_sink()) {
+        // Print out that the sink received a token at time
+        LOG_INFO("Sink recv'd at %lu (I=%lu, c=%u): ",
+                 (unsigned long) clock_time(), (unsigned long) tt.i_cur, tt.c);
+        LOG_INFO("Our token=0x%02x, theirs=0x%02x\n", token, theirs);
+    } else {
+        // Print out that the sink received a token at time
+        LOG_INFO("At %lu (I=%lu, c=%u): ",
+                 (unsigned long) clock_time(), (unsigned long) tt.i_cur, tt.c);
+        LOG_INFO("Our token=0x%02x, theirs=0x%02x\n", token, theirs);
+    }
+    if (token == theirs) {
+        LOG_INFO("Consistent RX\n");
+        trickle_timer_consistency(&tt);
+    } else {
+        if ((signed char) (token - theirs) < 0) {
+            LOG_INFO("Theirs is newer. Update\n");
+            token = theirs;
         } else {
-            // Print out that the sink received a token at time
-            LOG_INFO("At %lu (I=%lu, c=%u): ",
-                     (unsigned long) clock_time(), (unsigned long) tt.i_cur, tt.c);
-            LOG_INFO("Our token=0x%02x, theirs=0x%02x\n", token,
-                     ((uint8_t *) uip_appdata)[0]);
+            LOG_INFO("They are behind\n");
         }
-        if (token == ((uint8_t *) uip_appdata)[0]) {
-            LOG_INFO("Consistent RX\n");
-            trickle_timer_consistency(&tt);
+        trickle_timer_inconsistency(&tt);
+
+        /*
+         * Here tt.ct.etimer.timer.{start + interval} points to time t in the
+         * current interval. However, between t and I it points to the interval's
+         * end so if you're going to use this, do so with caution.
+         */
+        LOG_INFO("At %lu: Trickle inconsistency. Scheduled TX for %lu\n",
+                 (unsigned long) clock_time(),
+                 (unsigned long) (tt.ct.etimer.timer.start +
+                                  tt.ct.etimer.timer.interval));
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+tcpip_handler(void) {
+    if (uip_newdata()) {
+        if (uip_udp_conn == collect_conn) {
+            tpwsn_collect_input(uip_appdata, uip_datalen());
         } else {
-            if ((signed char) (token - ((uint8_t *) uip_appdata)[0]) < 0) {
-                LOG_INFO("Theirs is newer. Update\n");
-                token = ((uint8_t *) uip_appdata)[0];
-            } else {
-                LOG_INFO("They are behind\n");
-            }
-            trickle_timer_inconsistency(&tt);
-
-            /*
-             * Here tt.ct.etimer.timer.{start + interval} points to time t in the
-             * current interval. However, between t and I it points to the interval's
-             * end so if you're going to use this, do so with caution.
-             */
-            LOG_INFO("At %lu: Trickle inconsistency. Scheduled TX for %lu\n",
-                     (unsigned long) clock_time(),
-                     (unsigned long) (tt.ct.etimer.timer.start +
-                                      tt.ct.etimer.timer.interval));
+            tpwsn_rx(uip_appdata, uip_datalen());
         }
     }
     return;
@@ -144,7 +195,14 @@ trickle_tx(void *ptr, uint8_t suppress) {
      * and cast it to a local struct trickle_timer* */
     struct trickle_timer *loc_tt = (struct trickle_timer *) ptr;
 
-    if (suppress == TRICKLE_TIMER_TX_SUPPRESS || suppress_trickle) {
+    if (suppress == TRICKLE_TIMER_TX_SUPPRESS) {
+        return;
+    }
+    if (is_leaf()) {
+        ++leaf_skipped;
+        return;
+    }
+    if (!tpwsn_tx()) {
         return;
     }
 
@@ -166,13 +224,80 @@ trickle_tx(void *ptr, uint8_t suppress) {
     uip_create_unspecified(&trickle_conn->ripaddr);
 }
 
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+ms_to_ticks(long ms) {
+    return (clock_time_t) ms * CLOCK_SECOND / 1000;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+new_version(void *ptr) {
+    if (pending_updates == 0) {
+        return;
+    }
+    if (token < msg_limit) {
+        token++;
+        ++version_count;
+        LOG_INFO("At %lu: Generating a new token 0x%02x from %u updates\n",
+                 (unsigned long) clock_time(), token, pending_updates);
+        trickle_timer_reset_event(&tt);
+    }
+    pending_updates = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+source_update(void) {
+    ++update_count;
+    ++pending_updates;
+    LOG_INFO("At %lu: Source update %u\n",
+             (unsigned long) clock_time(), update_count);
+
+    if (coalesce_ms <= 0) {
+        new_version(NULL);
+    } else if (ctimer_expired(&coalesce_timer)) {
+        ctimer_set(&coalesce_timer, ms_to_ticks(coalesce_ms), new_version, NULL);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+burst_update(void *ptr) {
+    if (!tpwsn_is_up() || !tpwsn_is_source()) {
+        burst_left = 0;
+        return;
+    }
+    source_update();
+    if (--burst_left > 0) {
+        ctimer_set(&burst_timer, ms_to_ticks(burst_ms), burst_update, NULL);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Leaves never transmit, so they send no coverage summaries either and
+ * are left out of the collected coverage.
+ */
+static void
+collect_send(const void *data, uint16_t len) {
+    if (is_leaf()) {
+        ++leaf_skipped;
+        return;
+    }
+    uip_ipaddr_copy(&collect_conn->ripaddr, &ipaddr);
+    uip_udp_packet_send(collect_conn, data, len);
+    uip_create_unspecified(&collect_conn->ripaddr);
+}
+
 /*---------------------------------------------------------------------------*/
 static void
 trickle_init() {
     token = 0;
-    suppress_trickle = false;
 
-    trickle_timer_config(&tt, imin, imax, redundancy_const);
+    trickle_timer_config(&tt, imin << duty_shift,
+                         imax > duty_shift ? imax - duty_shift : 0,
+                         redundancy_const);
     trickle_timer_set(&tt, trickle_tx, &tt);
     /*
      * At this point trickle is started and is running the first interval. All
@@ -184,147 +309,245 @@ trickle_init() {
 
 /*---------------------------------------------------------------------------*/
 static void
-serial_handler(char *data) {
-    char *ptr = strtok(data, " ");
+trickle_on_sleep(void) {
+    // Stop all timers to emulate power loss
+    trickle_timer_stop(&tt);
+    etimer_stop(&et);
+    ctimer_stop(&coalesce_timer);
+    ctimer_stop(&burst_timer);
+    pending_updates = 0;
+    burst_left = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+trickle_coverage_state(void) {
+    return token;
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+trickle_stats(void) {
+    LOG_INFO("trickle token 0x%02x imin %ld imax %ld k %ld limit %ld I=%lu c=%u\n",
+             token, imin, imax, redundancy_const, msg_limit,
+             (unsigned long) tt.i_cur, tt.c);
+    LOG_INFO("trickle updates %u versions %u coalesce %ld\n",
+             update_count, version_count, coalesce_ms);
+    LOG_INFO("trickle leaf %d mode %d threshold %ld skipped %u\n",
+             is_leaf(), leaf_mode, leaf_threshold, leaf_skipped);
+#if UIP_STATISTICS
+    /* ICMPv6 counts the control traffic of the IPv6 stack (RPL, ND) */
+    LOG_INFO("uip ip sent %u recv %u icmp sent %u recv %u udp sent %u recv %u\n",
+             uip_stat.ip.sent, uip_stat.ip.recv, uip_stat.icmp.sent,
+             uip_stat.icmp.recv, uip_stat.udp.sent, uip_stat.udp.recv);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+trickle_command(char *ptr) {
+    static bool seen_init = false;
+    static bool seen_imax = false;
+    static bool seen_imin = false;
+    static bool seen_limit = false;
+    static bool seen_coalesce = false;
+    static bool seen_burst = false;
+    static bool seen_burst_ms = false;
+    static bool seen_leaf = false;
+    static bool seen_leaf_level = false;
     char *endptr;
-    long delay = 0;
-    bool seen_sleep = false;
-    bool seen_set = false;
-    bool seen_init = false;
-    bool seen_imin = false;
-    bool seen_imax = false;
-    bool seen_cost = false;
-    bool seen_limit = false;
-    bool seen_print = false;
-
-    // Iterate over the tokenised string
-    while (ptr != NULL) {
-        // Parse serial input to initialise trickle
-        if (strcmp(ptr, "init") == 0) {
-            seen_init = true;
-        }
-        if (seen_init) {
-            if (seen_imax && seen_imin && seen_cost) {
-                break;
-            } else if (seen_imin && seen_imax) {
-                redundancy_const = strtol(ptr, &endptr, 10);
-                seen_cost = true;
-            } else if (!seen_imax && !seen_imin) {
-                imax = strtol(ptr, &endptr, 10);
-                seen_imax = true;
-            } else if (seen_imax && !seen_imin) {
-                imin = strtol(ptr, &endptr, 10);
-                seen_imin = true;
-            }
-        }
 
-        // Parse serial input for setting a source message limit
-        if (strcmp(ptr, "limit") == 0) {
-            LOG_INFO("Seen limit\n");
-            seen_limit = true;
-        }
-        if (seen_limit) {
-            msg_limit = strtol(ptr, &endptr, 10);
-            LOG_INFO("Setting limit to %ld\n", msg_limit);
-        }
+    // The end of the line terminates any argument list
+    if (ptr == NULL) {
+        seen_init = seen_imax = seen_imin = seen_limit = false;
+        seen_coalesce = seen_burst = seen_burst_ms = false;
+        seen_leaf = seen_leaf_level = false;
+        return;
+    }
 
-        // Parse serial input to output the current token of the node
-        if (strcmp(ptr, "print") == 0) {
-            LOG_INFO("Seen print\n");
-            seen_print = true;
-        }
-        if (seen_print) {
-            LOG_INFO("Current token: %d\n", token);
-            NETSTACK_RADIO.off();
-            suppress_trickle = true;
+    // Parse serial input to initialise trickle
+    if (seen_init) {
+        if (seen_imin && seen_imax) {
+            redundancy_const = strtol(ptr, &endptr, 10);
+            seen_init = seen_imax = seen_imin = false;
+            LOG_INFO("Setting Imax=%ld Imin=%ld k=%ld\n",
+                     imax, imin, redundancy_const);
+            trickle_init();
+        } else if (!seen_imax) {
+            imax = strtol(ptr, &endptr, 10);
+            seen_imax = true;
+        } else {
+            imin = strtol(ptr, &endptr, 10);
+            seen_imin = true;
         }
+        return;
+    }
 
-        // Parse serial input for restarting a node
-        if (strcmp(ptr, "sleep") == 0) {
-            seen_sleep = true;
-        }
-        if (seen_sleep) {
-            delay = strtol(ptr, &endptr, 10);
-        }
+    // Parse serial input for setting a source message limit
+    if (seen_limit) {
+        msg_limit = strtol(ptr, &endptr, 10);
+        LOG_INFO("Setting limit to %ld\n", msg_limit);
+        seen_limit = false;
+        return;
+    }
 
-        // Parse serial input to set a node as a sink or source
-        if (strcmp(ptr, "set")) {
-            seen_set = true;
+    // Parse serial input for setting the source coalescing window
+    if (seen_coalesce) {
+        coalesce_ms = strtol(ptr, &endptr, 10);
+        LOG_INFO("Setting coalescing window to %ld ms\n", coalesce_ms);
+        seen_coalesce = false;
+        return;
+    }
+
+    // Parse serial input for a burst of source updates
+    if (seen_burst_ms) {
+        burst_ms = strtol(ptr, &endptr, 10);
+        seen_burst_ms = false;
+        LOG_INFO("Starting a burst of %ld updates every %ld ms\n",
+                 burst_left, burst_ms);
+        if (burst_left > 0) {
+            burst_update(NULL);
         }
-        if (seen_set) {
-            if (strcmp(ptr, "sink") == 0) {
-                LOG_INFO("Setting node status to SINK\n");
-                is_sink = true;
-                trickle_init();
-            } else if (strcmp(ptr, "source") == 0) {
-                LOG_INFO("Setting node status to SOURCE\n");
-                is_source = true;
-                trickle_init();
-            }
+        return;
+    }
+    if (seen_burst) {
+        burst_left = strtol(ptr, &endptr, 10);
+        seen_burst = false;
+        seen_burst_ms = true;
+        return;
+    }
+
+    // Parse serial input for the leaf role
+    if (seen_leaf_level) {
+        leaf_threshold = strtol(ptr, &endptr, 10);
+        leaf_mode = LEAF_AUTO;
+        LOG_INFO("Leaf below energy %ld, leaf %d\n", leaf_threshold, is_leaf());
+        seen_leaf_level = false;
+        return;
+    }
+    if (seen_leaf) {
+        if (strcmp(ptr, "auto") == 0) {
+            seen_leaf_level = true;
+        } else {
+            leaf_mode = strcmp(ptr, "on") == 0 ? LEAF_ON : LEAF_OFF;
+            LOG_INFO("Setting leaf role %s\n", ptr);
         }
+        seen_leaf = false;
+        return;
+    }
+
+    if (strcmp(ptr, "init") == 0) {
+        seen_init = true;
+    } else if (strcmp(ptr, "limit") == 0) {
+        LOG_INFO("Seen limit\n");
+        seen_limit = true;
+    } else if (strcmp(ptr, "leaf") == 0) {
+        seen_leaf = true;
+    } else if (strcmp(ptr, "coalesce") == 0) {
+        seen_coalesce = true;
+    } else if (strcmp(ptr, "burst") == 0) {
+        ctimer_stop(&burst_timer);
+        burst_left = 0;
+        seen_burst = true;
+    }
+}
 
-        ptr = strtok(NULL, " ");
+/*---------------------------------------------------------------------------*/
+static void
+trickle_on_energy(uint16_t level) {
+    if (leaf_mode == LEAF_AUTO) {
+        LOG_INFO("At %lu: Energy %u, leaf %d\n",
+                 (unsigned long) clock_time(), level, is_leaf());
     }
+}
 
-    if (seen_sleep && delay > 0) {
-        LOG_INFO("Restarting with delay of %ld seconds\n", delay);
+/*---------------------------------------------------------------------------*/
+/*
+ * Stretch Imin by one doubling each time the duty level halves, keeping
+ * the largest interval Imin * 2^Imax where it was.
+ */
+static void
+trickle_on_duty(uint8_t duty) {
+    uint8_t shift = 0;
 
-        NETSTACK_RADIO.off();
-        etimer_set(&rt, (delay * CLOCK_SECOND));
-        suppress_trickle = true;
-        reset_scheduled = true;
-        leds_on(LEDS_ALL);
+    while (shift < 4 && (uint16_t) duty * (2 << shift) <= 100) {
+        ++shift;
+    }
+    if (shift == duty_shift) {
+        return;
+    }
+    duty_shift = shift;
+    LOG_INFO("At %lu: Duty %u, imin %ld\n",
+             (unsigned long) clock_time(), duty, imin << duty_shift);
+
+    if (tpwsn_is_up()) {
+        trickle_timer_config(&tt, imin << duty_shift,
+                             imax > duty_shift ? imax - duty_shift : 0,
+                             redundancy_const);
+        trickle_timer_set(&tt, trickle_tx, &tt);
     }
 }
 
-/*-------------------------------------œ--------------------------------------*/
+/*---------------------------------------------------------------------------*/
 static void
-restart_node(void) {
-    // Reset the internal trickle state to emulate power loss
+trickle_protocol_init(void) {
+    uip_create_linklocal_allnodes_mcast(&ipaddr); /* Store for later */
+
+    trickle_conn = udp_new(NULL, UIP_HTONS(TRICKLE_PROTO_PORT), NULL);
+    udp_bind(trickle_conn, UIP_HTONS(TRICKLE_PROTO_PORT));
+
+    LOG_INFO("Connection: local/remote port %u/%u\n",
+             UIP_HTONS(trickle_conn->lport), UIP_HTONS(trickle_conn->rport));
+
+    collect_conn = udp_new(NULL, UIP_HTONS(COLLECT_PORT), NULL);
+    udp_bind(collect_conn, UIP_HTONS(COLLECT_PORT));
+    tpwsn_collect_open(collect_send);
+
     trickle_init();
-    etimer_stop(&rt);
-    reset_scheduled = false;
-    NETSTACK_RADIO.on();
-    leds_off(LEDS_ALL);
 }
+
+/*---------------------------------------------------------------------------*/
+static const struct tpwsn_protocol trickle_protocol = {
+    "trickle",
+    trickle_protocol_init,
+    trickle_on_sleep,
+    trickle_init,
+    trickle_on_rx,
+    trickle_coverage_state,
+    trickle_stats,
+    trickle_command,
+    trickle_on_energy,
+    trickle_on_duty,
+    NULL,
+};
+
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(trickle_protocol_process, ev, data) {
     PROCESS_BEGIN();
 
-                LOG_INFO("Trickle protocol started\n");
-
-                uip_create_linklocal_allnodes_mcast(&ipaddr); /* Store for later */
-
-                trickle_conn = udp_new(NULL, UIP_HTONS(TRICKLE_PROTO_PORT), NULL);
-                udp_bind(trickle_conn, UIP_HTONS(TRICKLE_PROTO_PORT));
-
-                LOG_INFO("Connection: local/remote port %u/%u\n",
-                         UIP_HTONS(trickle_conn->lport), UIP_HTONS(trickle_conn->rport));
-
-                trickle_init();
-
-                while (1) {
-                    PROCESS_YIELD();
-                    if (ev == tcpip_event) {
-                        tcpip_handler();
-                    } else if (ev == serial_line_event_message && data != NULL) {
-                        serial_handler(data);
-                    } else if (etimer_expired(&et) && is_source) {
-                        /* Periodically (and randomly) generate a new token. This will trigger
-                         * a trickle inconsistency */
-                        // Will only trigger a new token if the node is marked as a source node
-                        if ((random_rand() % NEW_TOKEN_PROB) == 0 && token < msg_limit) {
-                            token++;
-                            LOG_INFO("At %lu: Generating a new token 0x%02x\n",
-                                     (unsigned long) clock_time(), token);
-                            trickle_timer_reset_event(&tt);
-                        }
-                        etimer_set(&et, NEW_TOKEN_INTERVAL);
-                    } else if (etimer_expired(&rt) && reset_scheduled) {
-                        LOG_INFO("Restarting node at time %lu\n", (unsigned long) clock_time());
-                        restart_node();
-                    }
-                }
+    LOG_INFO("Trickle protocol started\n");
+
+    tpwsn_init(&trickle_protocol);
+
+    while (1) {
+        PROCESS_YIELD();
+        if (ev == tcpip_event) {
+            tcpip_handler();
+        } else if (ev == PROCESS_EVENT_TIMER && data == &et) {
+            /* Periodically (and randomly) generate a new token. This will trigger
+             * a trickle inconsistency */
+            // Will only trigger a new token if the node is marked as a source
+            // node. The timer runs on every node, so that a node made a
+            // source later starts generating tokens
+            if (tpwsn_is_source() &&
+                (random_rand() % NEW_TOKEN_PROB) == 0 && token < msg_limit) {
+                source_update();
+            }
+            etimer_set(&et, NEW_TOKEN_INTERVAL);
+        } else {
+            tpwsn_event(ev, data);
+        }
+    }
     PROCESS_END();
 }
-/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
\ No newline at end of file
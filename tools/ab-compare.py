@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Compare two firmware revisions over matched simulation runs.
+
+"run" simulates every scenario (a Cooja .csc file) with every seed for
+both builds, headless. The firmware of every mote type and the random
+seed are replaced in a copy of the scenario. The scenario's simulation
+script must log the mote output together with Cooja's mote IDs, e.g.
+
+  log.log(time + "\\tID:" + id + "\\t" + msg + "\\n");
+
+and send "stats" to every mote at the end of the run. Each run's
+COOJA.testlog is kept as <out>/<a|b>/<scenario>-<seed>.log, and the
+tpwsn.pcapng of a scenario running cooja/pcap-export.js as
+<scenario>-<seed>.pcapng. The unstripped image of each build (--a and
+--b, or --a-elf and --b-elf when the simulated images are stripped) is
+kept as <out>/<a|b>/firmware.elf.
+
+"compare" decodes the tokenised log records of each build with
+tlog-decode.py and the build's firmware.elf, and fails if any record is
+left undecoded. It then pairs the runs with the same scenario and
+seed, and reports for each metric (see tpwsnlog.run_metrics) the mean
+of both builds and of the paired differences B - A. Runs with a capture add the channel utilisation,
+overlap and SINR collisions of pcap-airtime.py --sinr. It also reports a
+95% bootstrap confidence interval of the mean difference, and the
+p-value of a paired t-test. A change is flagged as a regression or an
+improvement when the interval excludes 0 and p < --alpha.
+
+Usage: ab-compare.py run --cooja cooja.jar --a a.sky --b b.sky
+                         [--a-elf a.elf] [--b-elf b.elf]
+                         [--seeds 1-10] [--out runs] scenario.csc ...
+       ab-compare.py compare [--alpha 0.05] [--table table.json]
+                             runs/a runs/b
+"""
+
+import argparse
+import math
+import os
+import random
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+
+import tpwsnlog
+
+BOOTSTRAP = 10000
+# The unstripped image kept with the logs of each build
+FIRMWARE = "firmware.elf"
+# Marker of a tokenised record and the placeholders tlog-decode.py
+# writes for the records it cannot render
+UNDECODED = ("tlog:", "<unknown tlog token", "<malformed tlog record>")
+
+
+def seeds(text):
+    result = []
+    for part in text.split(","):
+        first, _, last = part.partition("-")
+        result.extend(range(int(first), int(last or first) + 1))
+    return result
+
+
+def scenario(csc, firmware, seed):
+    """The scenario with its firmware and random seed replaced"""
+    with open(csc) as f:
+        text = f.read()
+    text = re.sub(r"(<firmware[^>]*>)[^<]*(</firmware>)",
+                  lambda m: m.group(1) + os.path.abspath(firmware) +
+                  m.group(2), text)
+    text = re.sub(r"<randomseed>[^<]*</randomseed>",
+                  "<randomseed>%d</randomseed>" % seed, text)
+    return text
+
+
+def run(args):
+    for label, firmware, elf in (("a", args.a, args.a_elf),
+                                 ("b", args.b, args.b_elf)):
+        os.makedirs(os.path.join(args.out, label), exist_ok=True)
+        shutil.copy(elf or firmware,
+                    os.path.join(args.out, label, FIRMWARE))
+        for csc in args.scenarios:
+            name = os.path.splitext(os.path.basename(csc))[0]
+            for seed in seeds(args.seeds):
+                log = os.path.join(args.out, label,
+                                   "%s-%d.log" % (name, seed))
+                with tempfile.TemporaryDirectory() as work:
+                    sim = os.path.join(work, os.path.basename(csc))
+                    with open(sim, "w") as f:
+                        f.write(scenario(csc, firmware, seed))
+                    print("%s %s seed %d" % (label, name, seed))
+                    subprocess.run(["java", "-mx512m", "-jar",
+                                    os.path.abspath(args.cooja),
+                                    "-nogui=" + sim,
+                                    "-random-seed=%d" % seed],
+                                   cwd=work, check=True,
+                                   stdout=subprocess.DEVNULL)
+                    shutil.copy(os.path.join(work, "COOJA.testlog"), log)
+                    capture = os.path.join(work, "tpwsn.pcapng")
+                    if os.path.exists(capture):
+                        shutil.copy(capture,
+                                    os.path.splitext(log)[0] + ".pcapng")
+
+
+def betainc(a, b, x):
+    """Regularised incomplete beta function I_x(a, b)"""
+    if x <= 0 or x >= 1:
+        return max(0.0, min(1.0, x))
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) +
+                     a * math.log(x) + b * math.log(1 - x))
+    if x > (a + 1) / (a + b + 2):
+        return 1 - betainc(b, a, 1 - x)
+    # Lentz's continued fraction
+    c, d = 1.0, 1 - (a + b) * x / (a + 1)
+    d = 1 / (d if abs(d) > 1e-30 else 1e-30)
+    f = d
+    for m in range(1, 200):
+        for numerator in (m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m)),
+                          -(a + m) * (a + b + m) * x /
+                          ((a + 2 * m) * (a + 2 * m + 1))):
+            d = 1 + numerator * d
+            d = 1 / (d if abs(d) > 1e-30 else 1e-30)
+            c = 1 + numerator / c
+            c = c if abs(c) > 1e-30 else 1e-30
+            f *= c * d
+        if abs(c * d - 1) < 1e-12:
+            break
+    return front * f / a
+
+
+def paired_t(differences):
+    """Two-sided p-value of a paired t-test on the differences"""
+    n = len(differences)
+    if n < 2:
+        return None
+    sd = statistics.stdev(differences)
+    mean = statistics.mean(differences)
+    if sd == 0:
+        return 1.0 if mean == 0 else 0.0
+    t = mean / (sd / math.sqrt(n))
+    df = n - 1
+    return betainc(df / 2, 0.5, df / (df + t * t))
+
+
+def bootstrap(differences, rng):
+    """95% percentile bootstrap interval of the mean difference"""
+    n = len(differences)
+    means = sorted(sum(rng.choice(differences) for _ in range(n)) / n
+                   for _ in range(BOOTSTRAP))
+    return means[int(0.025 * BOOTSTRAP)], means[int(0.975 * BOOTSTRAP) - 1]
+
+
+def airtime(capture):
+    """The output of pcap-airtime.py --sinr for a capture"""
+    tool = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        "pcap-airtime.py")
+    result = subprocess.run([sys.executable, tool, "--sinr", capture],
+                            check=True, stdout=subprocess.PIPE,
+                            universal_newlines=True)
+    return result.stdout.splitlines()
+
+
+def decode(log, elf):
+    """The lines of a log with its tokenised records decoded by
+    tlog-decode.py, or as they are without an image"""
+    if not os.path.exists(elf):
+        with open(log, errors="replace") as f:
+            lines = f.readlines()
+    else:
+        tool = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                            "tlog-decode.py")
+        result = subprocess.run([sys.executable, tool, elf, log],
+                                check=True, stdout=subprocess.PIPE)
+        lines = result.stdout.decode(errors="replace").splitlines(True)
+    undecoded = [line for line in lines
+                 if any(marker in line for marker in UNDECODED)]
+    if undecoded:
+        raise SystemExit("%s: %d tlog records not decoded with %s, e.g. %s" % (
+            log, len(undecoded), elf, undecoded[0].strip()))
+    return lines
+
+
+def load(directory, table):
+    runs = {}
+    elf = os.path.join(directory, FIRMWARE)
+    for name in sorted(os.listdir(directory)):
+        if name.endswith(".log"):
+            capture = os.path.join(directory, name[:-4] + ".pcapng")
+            channel = airtime(capture) if os.path.exists(capture) else None
+            lines = decode(os.path.join(directory, name), elf)
+            runs[name] = tpwsnlog.run_metrics(lines, table, channel)
+    return runs
+
+
+def compare(args):
+    table = tpwsnlog.load_table(args.table)
+    a = load(args.dir_a, table)
+    b = load(args.dir_b, table)
+    pairs = sorted(set(a) & set(b))
+    if not pairs:
+        raise SystemExit("no runs with the same scenario and seed")
+    # Fixed seed, so that the report of the same runs does not change
+    rng = random.Random(1)
+
+    metrics = sorted({m for run in pairs for m in a[run]} &
+                     {m for run in pairs for m in b[run]})
+    print("%d paired runs, %d only in one build" % (
+        len(pairs), len(set(a) ^ set(b))))
+    print()
+    print("| metric | A | B | B - A | 95% CI | p | verdict |")
+    print("|---|---|---|---|---|---|---|")
+    regressions = 0
+    for metric in metrics:
+        runs = [r for r in pairs if metric in a[r] and metric in b[r]]
+        differences = [b[r][metric] - a[r][metric] for r in runs]
+        mean = statistics.mean(differences)
+        low, high = bootstrap(differences, rng)
+        p = paired_t(differences)
+        verdict = ""
+        if p is not None and p < args.alpha and (low > 0 or high < 0):
+            worse = (mean > 0) == (metric in tpwsnlog.LOWER_IS_BETTER)
+            verdict = "REGRESSION" if worse else "improvement"
+            regressions += worse
+        print("| %s | %.4g | %.4g | %+.4g | [%+.4g, %+.4g] | %s | %s |" % (
+            metric, statistics.mean(a[r][metric] for r in runs),
+            statistics.mean(b[r][metric] for r in runs), mean, low, high,
+            "-" if p is None else "%.3g" % p, verdict))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    p = commands.add_parser("run", help="simulate the scenarios")
+    p.add_argument("--cooja", required=True, help="path to cooja.jar")
+    p.add_argument("--a", required=True, help="firmware of build A")
+    p.add_argument("--b", required=True, help="firmware of build B")
+    p.add_argument("--a-elf", help="unstripped image of build A, if --a "
+                   "is stripped")
+    p.add_argument("--b-elf", help="unstripped image of build B, if --b "
+                   "is stripped")
+    p.add_argument("--seeds", default="1-10", help="e.g. 1-10 or 1,4,7")
+    p.add_argument("--out", default="runs", help="directory for the logs")
+    p.add_argument("scenarios", nargs="+", metavar="scenario.csc")
+
+    p = commands.add_parser("compare", help="compare the logs")
+    p.add_argument("--alpha", type=float, default=0.05)
+    p.add_argument("--table", help="JSON current-draw table")
+    p.add_argument("dir_a", metavar="a")
+    p.add_argument("dir_b", metavar="b")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        run(args)
+    else:
+        sys.exit(compare(args))
+
+
+if __name__ == "__main__":
+    main()
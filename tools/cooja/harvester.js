@@ -0,0 +1,125 @@
+/*
+ * Cooja simulation script emulating an energy harvester and a storage
+ * capacitor on every mote for the energy-neutral controller of the TPWSN
+ * firmwares (firmware/common/tpwsn-eno.h).
+ *
+ * Paste it into the Simulation script editor, or reference it from the
+ * <plugin>org.contikios.cooja.plugins.ScriptRunner</plugin> section of a
+ * .csc file, and start the controller with "eno on" on the motes.
+ *
+ * Every REPORT_MS the script adds the harvested energy to the capacitor
+ * of each mote and takes out what the mote spent, then writes
+ *
+ *   voltage <mV>
+ *
+ * to its serial line. The harvester is a solar cell over a day of DAY_MS
+ * simulated milliseconds: PEAK_UW at noon, nothing at night. Each mote
+ * gets a fixed shading factor between 0.5 and 1 from its ID, so that the
+ * income differs across the network. The consumption is the radio time
+ * observed on the medium (listening and transmitting) at the Sky supply
+ * currents of tools/tpwsnlog.py, plus a constant MCU draw. Other log
+ * lines are passed through to the script log.
+ *
+ * Motes added after the script started get no voltage reports.
+ */
+
+TIMEOUT(36000000, log.testOK());
+
+/* Capacitance in mF and initial voltage in mV, as TPWSN_ENO_CAPACITANCE
+   and TPWSN_ENO_V_TARGET in the firmware */
+var CAPACITANCE_MF = 100;
+var V_START_MV = 3000;
+/* The storage is clamped at this voltage, surplus energy is lost */
+var V_MAX_MV = 3600;
+
+var REPORT_MS = 1000;
+var DAY_MS = 600000;
+var PEAK_UW = 20000;
+
+/* Currents in mA, as DEFAULT_TABLE in tools/tpwsnlog.py. MCU_MA is the
+   average of a mostly idle CPU */
+var RX_MA = 18.8;
+var TX_MA = 17.4;
+var MCU_MA = 0.2;
+
+var motes = sim.getMotes();
+var state = {};
+
+/* Add the time since the last radio event to the state the radio was in */
+function account(s) {
+  var now = sim.getSimulationTime();
+  var us = now - s.since;
+  if(s.transmitting) {
+    s.txUs += us;
+  } else if(s.on) {
+    s.rxUs += us;
+  }
+  s.since = now;
+  s.on = s.radio.isRadioOn();
+  s.transmitting = s.radio.isTransmitting();
+}
+
+function shading(id) {
+  return 0.5 + 0.5 * ((id * 7919) % 101) / 100;
+}
+
+/* Harvested power in uW at a simulation time in ms */
+function harvest(ms, id) {
+  var sun = Math.sin(2 * Math.PI * (ms % DAY_MS) / DAY_MS);
+  return sun > 0 ? PEAK_UW * sun * shading(id) : 0;
+}
+
+function update(mote) {
+  var s = state[mote.getID()];
+  account(s);
+
+  var v = s.mv / 1000;
+  var spentUj = v * (RX_MA * s.rxUs + TX_MA * s.txUs) / 1000 +
+      v * MCU_MA * REPORT_MS;
+  var harvestedUj = harvest(sim.getSimulationTimeMillis(), mote.getID()) *
+      REPORT_MS / 1000;
+  s.rxUs = s.txUs = 0;
+
+  /* E = C V^2 / 2, in uJ with C in mF and V in mV */
+  var uj = CAPACITANCE_MF * s.mv * s.mv / 2000 + harvestedUj - spentUj;
+  s.mv = uj > 0 ? Math.sqrt(uj * 2000 / CAPACITANCE_MF) : 0;
+  if(s.mv > V_MAX_MV) {
+    s.mv = V_MAX_MV;
+  }
+  write(mote, "voltage " + Math.round(s.mv));
+}
+
+for(var i = 0; i < motes.length; i++) {
+  var radio = motes[i].getInterfaces().getRadio();
+  var s = { radio: radio, mv: V_START_MV, since: sim.getSimulationTime(),
+            on: radio.isRadioOn(), transmitting: radio.isTransmitting(),
+            rxUs: 0, txUs: 0 };
+  state[motes[i].getID()] = s;
+
+  (function(s) {
+    if(radio.getRadioEventTriggers !== undefined) {
+      radio.getRadioEventTriggers().addTrigger(this, function(ev, r) {
+        account(s);
+      });
+    } else {
+      radio.addObserver(new java.util.Observer({
+        update: function(obs, obj) { account(s); }
+      }));
+    }
+  })(s);
+}
+log.log("Harvesting for " + motes.length + " motes\n");
+
+GENERATE_MSG(REPORT_MS, "harvest");
+while(true) {
+  YIELD();
+
+  if(msg.equals("harvest")) {
+    for(var i = 0; i < motes.length; i++) {
+      update(motes[i]);
+    }
+    GENERATE_MSG(REPORT_MS, "harvest");
+  } else {
+    log.log(mote + ": " + msg + "\n");
+  }
+}
@@ -0,0 +1,173 @@
+/*
+ * Cooja simulation script writing every frame sent over the radio medium
+ * to a pcapng file, for the airtime analysis of tools/pcap-airtime.py.
+ *
+ * Paste it into the Simulation script editor, or reference it from the
+ * <plugin>org.contikios.cooja.plugins.ScriptRunner</plugin> section of a
+ * .csc file. It works for any firmware, as it only observes the radios.
+ *
+ * The file has one interface per mote, named "mote <id>" and described
+ * with the mote's position "x <x> y <y>". Each frame is an enhanced
+ * packet block on the interface of its sender, timestamped in
+ * microseconds of simulated time at the start of the transmission, with
+ * the link type IEEE 802.15.4 (with FCS) like Cooja's radio logger. Its
+ * comment lists the motes that received it and the motes where it was
+ * interfered:
+ *
+ *   dest <id>,<id>,... interfered <id>,...
+ *
+ * Motes added after the script started are not captured.
+ */
+
+TIMEOUT(36000000, log.testOK());
+
+var OUTPUT = "tpwsn.pcapng";
+var LINKTYPE_IEEE802_15_4 = 195;
+
+var medium = sim.getRadioMedium();
+var out = new java.io.BufferedOutputStream(new java.io.FileOutputStream(OUTPUT));
+var motes = sim.getMotes();
+var interfaces = {};
+var started = {};
+var frames = 0;
+
+function u16(v) {
+  out.write(v & 0xff);
+  out.write((v >> 8) & 0xff);
+}
+
+function u32(v) {
+  u16(v & 0xffff);
+  u16(Math.floor(v / 65536) & 0xffff);
+}
+
+function padding(len) {
+  return (4 - len % 4) % 4;
+}
+
+function bytes(s) {
+  return new java.lang.String(s).getBytes("UTF-8");
+}
+
+/* Write an option of a pcapng block, padded to 32 bits */
+function option(code, value) {
+  u16(code);
+  u16(value.length);
+  out.write(value, 0, value.length);
+  for(var i = 0; i < padding(value.length); i++) {
+    out.write(0);
+  }
+}
+
+function optionLength(value) {
+  return 4 + value.length + padding(value.length);
+}
+
+function sectionHeader() {
+  u32(0x0a0d0d0a);
+  u32(28);
+  u32(0x1a2b3c4d);
+  u16(1);
+  u16(0);
+  u32(0xffffffff);
+  u32(0xffffffff);
+  u32(28);
+}
+
+function interfaceDescription(mote) {
+  var pos = mote.getInterfaces().getPosition();
+  var name = bytes("mote " + mote.getID());
+  var description = bytes("x " + pos.getXCoordinate().toFixed(2) +
+                          " y " + pos.getYCoordinate().toFixed(2));
+  var len = 20 + optionLength(name) + optionLength(description) + 4;
+
+  u32(1);
+  u32(len);
+  u16(LINKTYPE_IEEE802_15_4);
+  u16(0);
+  u32(0);
+  option(2, name);
+  option(3, description);
+  u32(0);
+  u32(len);
+}
+
+function ids(radios) {
+  var result = [];
+  for(var i = 0; i < radios.length; i++) {
+    result.push(radios[i].getMote().getID());
+  }
+  return result.join(",");
+}
+
+function connectionOf(radio) {
+  var connections = medium.getActiveConnections();
+  for(var i = 0; i < connections.length; i++) {
+    if(connections[i].getSource() == radio) {
+      return connections[i];
+    }
+  }
+  return null;
+}
+
+function enhancedPacket(radio, start) {
+  var data = radio.getLastPacketTransmitted().getPacketData();
+  var conn = connectionOf(radio);
+  var comment = bytes("dest " + (conn == null ? "" : ids(conn.getDestinations())) +
+                      " interfered " + (conn == null ? "" : ids(conn.getInterfered())));
+  var len = 28 + data.length + padding(data.length) + optionLength(comment) + 4 + 4;
+
+  u32(6);
+  u32(len);
+  u32(interfaces[radio.getMote().getID()]);
+  u32(Math.floor(start / 4294967296));
+  u32(start % 4294967296);
+  u32(data.length);
+  u32(data.length);
+  out.write(data, 0, data.length);
+  for(var i = 0; i < padding(data.length); i++) {
+    out.write(0);
+  }
+  option(1, comment);
+  u32(0);
+  u32(len);
+  out.flush();
+  ++frames;
+}
+
+function radioEvent(radio) {
+  var ev = radio.getLastEvent();
+  var id = radio.getMote().getID();
+
+  if(ev == org.contikios.cooja.interfaces.Radio.RadioEvent.TRANSMISSION_STARTED) {
+    started[id] = sim.getSimulationTime();
+  } else if(ev == org.contikios.cooja.interfaces.Radio.RadioEvent.PACKET_TRANSMITTED &&
+            started[id] !== undefined) {
+    enhancedPacket(radio, started[id]);
+  }
+}
+
+sectionHeader();
+for(var i = 0; i < motes.length; i++) {
+  var radio = motes[i].getInterfaces().getRadio();
+  interfaces[motes[i].getID()] = i;
+  interfaceDescription(motes[i]);
+
+  (function(radio) {
+    if(radio.getRadioEventTriggers !== undefined) {
+      radio.getRadioEventTriggers().addTrigger(this, function(ev, r) {
+        radioEvent(radio);
+      });
+    } else {
+      radio.addObserver(new java.util.Observer({
+        update: function(obs, obj) { radioEvent(radio); }
+      }));
+    }
+  })(radio);
+}
+out.flush();
+log.log("Writing " + motes.length + " interfaces to " + OUTPUT + "\n");
+
+while(true) {
+  YIELD();
+}
@@ -0,0 +1,72 @@
+/*
+ * Cooja simulation script emulating a wake-up receiver on every mote for
+ * the "wur on" mode of the TPWSN firmwares (firmware/common/tpwsn-wur.h).
+ *
+ * Paste it into the Simulation script editor, or reference it from the
+ * <plugin>org.contikios.cooja.plugins.ScriptRunner</plugin> section of a
+ * .csc file. Whenever a mote prints
+ *
+ *   <addr>: WUC <receiver link address>
+ *
+ * the script writes "wake <WAKE_MS>" to the serial line of the addressed
+ * mote, or of every other mote for an all-zero (broadcast) address, if
+ * it is within transmission range of the caller. Other log lines are
+ * ignored.
+ *
+ * Rime (Contiki 3) link addresses are <id & 0xff>.<id >> 8>, and the
+ * 8-byte Contiki-NG addresses of Sky motes end with the mote ID, high
+ * byte first.
+ */
+
+TIMEOUT(36000000, log.testOK());
+
+/* Listening time of a woken mote, long enough for the wake-up latency,
+   CSMA backoffs and the transmission */
+var WAKE_MS = 200;
+
+var medium = sim.getRadioMedium();
+var range = (medium.getTransmissionRange !== undefined) ?
+    medium.getTransmissionRange() : -1;
+
+/* Rime link addresses are the mote ID, low byte first. The 8-byte
+   Contiki-NG addresses hold it in their last two bytes, high byte first */
+function receiverId(bytes) {
+  if(bytes.length == 2) {
+    return bytes[0] + 256 * bytes[1];
+  }
+  return bytes[6] * 256 + bytes[7];
+}
+
+function inRange(a, b) {
+  if(range < 0) {
+    return true;
+  }
+  return a.getInterfaces().getPosition().getDistanceTo(b) <= range;
+}
+
+function wake(caller, target) {
+  if(target != null && target != caller && inRange(caller, target)) {
+    write(target, "wake " + WAKE_MS);
+  }
+}
+
+while(true) {
+  YIELD();
+
+  var m = msg.match(/WUC ([0-9.]+)/);
+  if(m == null) {
+    continue;
+  }
+
+  var bytes = m[1].split(".").map(function(b) { return parseInt(b, 10); });
+  var broadcast = bytes.every(function(b) { return b == 0; });
+
+  if(broadcast) {
+    var motes = sim.getMotes();
+    for(var i = 0; i < motes.length; i++) {
+      wake(mote, motes[i]);
+    }
+  } else {
+    wake(mote, sim.getMoteWithID(receiverId(bytes)));
+  }
+}
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Convert the Energest times of a run into joules.
+
+Applies a current-draw table (the Tmote Sky table of
+firmware/common/tpwsn-energy.h by default, or a JSON file with any of its
+keys replaced, see tpwsnlog.DEFAULT_TABLE) to the last "energest" line of
+every node and reports:
+
+- the energy of each node by state (CPU, LPM, radio TX and listen);
+- the energy per event type: per frame sent (TX energy over the MAC
+  frames, or the protocol transmissions without the MAC wrapper), per
+  protocol transmission, and listen energy per protocol message
+  received;
+- the network energy per successful dissemination: per packet delivered
+  to a sink for RMH, per token version received by a sink for Trickle.
+
+The log must hold the output of "stats" sent to every node at the end of
+the run. Flash currents are part of the table but unused, as neither
+firmware writes to the flash.
+
+Usage: energy-model.py [--table table.json] [log]
+"""
+
+import argparse
+import re
+import sys
+
+import tpwsnlog
+
+SINK_TOKEN_RE = re.compile(r"Sink recv'd .*theirs=0x([0-9a-f]+)")
+
+
+def disseminations(nodes, tokens):
+    """Successful disseminations of the run, None if it cannot tell"""
+    delivered = [n["rmh"]["delivered"] for n in nodes.values()
+                 if n.get("rmh", {}).get("sink")]
+    if delivered:
+        return sum(delivered)
+    if tokens:
+        return len(tokens)
+    return None
+
+
+def per_event(name, joules, count):
+    if count:
+        print("%-26s %10.3f mJ  (%d events)" % (name, 1000 * joules / count,
+                                                count))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--table", help="JSON current-draw table")
+    parser.add_argument("log", nargs="?", help="log file, default stdin")
+    args = parser.parse_args()
+
+    table = tpwsnlog.load_table(args.table)
+    lines = list(open(args.log) if args.log else sys.stdin)
+    nodes = tpwsnlog.parse_stats(lines)
+    tokens = {m.group(1) for m in map(SINK_TOKEN_RE.search, lines)
+              if m is not None and int(m.group(1), 16) != 0}
+
+    totals = dict.fromkeys(tpwsnlog.STATES, 0.0)
+    frames = tx = rx = 0
+    print("%-8s %10s %10s %10s %10s %10s" % (
+        "node", "cpu mJ", "lpm mJ", "tx mJ", "rx mJ", "total mJ"))
+    for node in sorted(nodes, key=lambda a: [int(p) for p in a.split(".")]):
+        stats = nodes[node]
+        if "energest" not in stats:
+            continue
+        joules = tpwsnlog.energy(table, stats["energest"])
+        for state in tpwsnlog.STATES:
+            totals[state] += joules[state]
+        print("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f" % (
+            (node,) + tuple(1000 * joules[s] for s in tpwsnlog.STATES) +
+            (1000 * sum(joules.values()),)))
+
+        harness = stats.get("stats", {})
+        mac = stats.get("mac", {})
+        tx += harness.get("tx", 0)
+        rx += harness.get("rx", 0)
+        frames += (mac.get("ucast", 0) + mac.get("bcast", 0)) if mac \
+            else harness.get("tx", 0)
+
+    total = sum(totals.values())
+    print("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f" % (
+        ("all",) + tuple(1000 * totals[s] for s in tpwsnlog.STATES) +
+        (1000 * total,)))
+    print()
+
+    per_event("frame sent (tx)", totals["tx"], frames)
+    per_event("protocol transmission (tx)", totals["tx"], tx)
+    per_event("message received (listen)", totals["rx"], rx)
+
+    count = disseminations(nodes, tokens)
+    if count:
+        print("%-26s %10.3f mJ  (%d disseminations)" % (
+            "successful dissemination", 1000 * total / count, count))
+    else:
+        print("successful dissemination: none found")
+
+
+if __name__ == "__main__":
+    main()
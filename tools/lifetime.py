@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Extrapolate the lifetime of battery-powered nodes from a run.
+
+The average power of every node is its energy (the last "energest" line
+through the current-draw table, see energy-model.py) over its uptime
+(CPU plus LPM time). Assuming the node keeps drawing that power, it dies
+once it has drawn the battery capacity (--capacity mAh at the table's
+voltage). The tool prints:
+
+- the time to first node death, and every node in the order it dies
+  with its role: source, sink, sink neighbour (RMH gradient 1, or
+  within --range of a sink with --csc), backbone relay (RMH "cds on"),
+  or Trickle leaf;
+- the coverage lifetime curve: after each death, the share of the
+  other nodes still alive and, with --csc, still connected to a sink
+  (RMH) or a source (Trickle) through live nodes within --range;
+- with --csc, a map of the simulation area where each mote is drawn as
+  the decile of its death order, 0 for the first tenth to die.
+
+Positions come from the Cooja .csc file and are matched to the nodes
+through the "ID:<n>" field of Cooja's log.
+
+Usage: lifetime.py [--capacity 220] [--table table.json]
+                   [--csc sim.csc] [--range 50] [log]
+"""
+
+import argparse
+import collections
+import math
+import sys
+
+import tpwsnlog
+
+MAP_COLUMNS = 64
+MAP_ROWS = 24
+
+
+def roles(stats, near_sink):
+    tags = []
+    harness = stats.get("stats", {})
+    if harness.get("source"):
+        tags.append("source")
+    if harness.get("sink"):
+        tags.append("sink")
+    if stats.get("rmh", {}).get("gradient") == 1 or near_sink:
+        tags.append("sink-neighbour")
+    if stats.get("rmh", {}).get("backbone"):
+        tags.append("backbone")
+    if stats.get("trickle leaf", {}).get("leaf"):
+        tags.append("leaf")
+    return tags
+
+
+def connected(alive, targets, positions, reach):
+    """The live nodes reachable from the live targets"""
+    seen = {n for n in targets if n in alive}
+    queue = collections.deque(seen)
+    while queue:
+        node = queue.popleft()
+        x, y = positions[node]
+        for other in alive:
+            if other not in seen and \
+                    math.hypot(x - positions[other][0],
+                               y - positions[other][1]) <= reach:
+                seen.add(other)
+                queue.append(other)
+    return seen
+
+
+def draw(order, positions):
+    xs = [positions[n][0] for n in order]
+    ys = [positions[n][1] for n in order]
+    width = max(max(xs) - min(xs), 1e-9)
+    height = max(max(ys) - min(ys), 1e-9)
+    # Character cells are about twice as high as wide
+    rows = max(1, min(MAP_ROWS, round(height / width * MAP_COLUMNS / 2) + 1))
+    grid = [[" "] * MAP_COLUMNS for _ in range(rows)]
+    for rank, node in enumerate(order):
+        x, y = positions[node]
+        column = int((x - min(xs)) / width * (MAP_COLUMNS - 1))
+        row = int((y - min(ys)) / height * (rows - 1))
+        grid[row][column] = str(rank * 10 // len(order))
+    for row in grid:
+        print("|" + "".join(row).rstrip())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--capacity", type=float, default=220.0,
+                        help="battery capacity in mAh, CR2032 by default")
+    parser.add_argument("--table", help="JSON current-draw table")
+    parser.add_argument("--csc", help="Cooja simulation with the positions")
+    parser.add_argument("--range", type=float, default=50.0,
+                        help="transmission range")
+    parser.add_argument("log", nargs="?", help="log file, default stdin")
+    args = parser.parse_args()
+
+    table = tpwsnlog.load_table(args.table)
+    lines = list(open(args.log) if args.log else sys.stdin)
+    nodes = {n: s for n, s in tpwsnlog.parse_stats(lines).items()
+             if "energest" in s}
+    if not nodes:
+        raise SystemExit("no energest lines in the log")
+    battery = args.capacity * 3.6 * table["voltage"]   # J
+
+    positions = {}
+    if args.csc:
+        ids = tpwsnlog.mote_ids(lines)
+        cooja = tpwsnlog.read_positions(args.csc)
+        positions = {n: cooja[ids[n]] for n in nodes
+                     if n in ids and ids[n] in cooja}
+
+    sinks = [n for n, s in nodes.items() if s.get("stats", {}).get("sink")]
+    sources = [n for n, s in nodes.items()
+               if s.get("stats", {}).get("source")]
+
+    lifetime = {}
+    for node, stats in nodes.items():
+        energest = stats["energest"]
+        uptime = (energest.get("cpu", 0) + energest.get("lpm", 0)) / \
+            table["ticks_per_second"]
+        joules = sum(tpwsnlog.energy(table, energest).values())
+        power = joules / uptime if uptime > 0 else 0.0
+        lifetime[node] = (battery / power if power > 0 else math.inf, power)
+    order = sorted(nodes, key=lambda n: lifetime[n][0])
+
+    first = lifetime[order[0]][0]
+    print("battery %.0f mAh (%.0f J), first death %s after %.1f days" % (
+        args.capacity, battery, order[0], first / 86400))
+    print()
+    print("%-8s %10s %12s  %s" % ("node", "power mW", "lifetime d", "role"))
+    for node in order:
+        near = node in positions and any(
+            s in positions and s != node and
+            math.dist(positions[node], positions[s]) <= args.range
+            for s in sinks)
+        seconds, power = lifetime[node]
+        print("%-8s %10.3f %12.1f  %s" % (
+            node, 1000 * power, seconds / 86400,
+            " ".join(roles(nodes[node], near))))
+
+    # With positions, coverage is measured from the sinks for RMH and from
+    # the sources for Trickle
+    targets = sinks if any("rmh" in s for s in nodes.values()) else sources
+    located = len(positions) == len(nodes) and targets
+    print()
+    print("coverage lifetime (days, %s):" % (
+        "connected share" if located else "share alive"))
+    alive = set(nodes)
+    for node in order:
+        alive.discard(node)
+        rest = [n for n in nodes if n not in targets]
+        if located:
+            reached = connected(alive, targets, positions, args.range)
+            share = sum(1 for n in rest if n in reached) / max(len(rest), 1)
+        else:
+            share = len(alive) / len(nodes)
+        print("%10.1f %6.1f%%" % (lifetime[node][0] / 86400, 100 * share))
+
+    if positions:
+        print()
+        print("death order by decile (0 dies first):")
+        draw([n for n in order if n in positions], positions)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Tabulate the results of the microbenchmark firmware.
+
+Reads the "BENCH,<primitive>,<param>,<iterations>,<ticks>,<cycles>"
+lines printed by firmware/microbench, subtracts the cost of the empty
+loop from every primitive and prints, per primitive, the net cycles per
+call at each parameter (list length, pool occupancy or timer load) with
+the most expensive primitive first. With --csv the net figures are
+written as CSV instead.
+
+Usage: microbench.py [--csv] [log]
+"""
+
+import argparse
+import collections
+import csv
+import re
+import sys
+
+BENCH_RE = re.compile(r"BENCH,([a-z_+]+),(\d+),(\d+),(\d+),(\d+)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--csv", action="store_true", help="write CSV")
+    parser.add_argument("log", nargs="?", help="log file, default stdin")
+    args = parser.parse_args()
+
+    results = collections.defaultdict(dict)
+    for line in open(args.log) if args.log else sys.stdin:
+        m = BENCH_RE.search(line)
+        if m is not None:
+            results[m.group(1)][int(m.group(2))] = int(m.group(5))
+    baseline = results.pop("empty", {}).get(0, 0)
+    results.pop("done", None)
+    if not results:
+        raise SystemExit("no BENCH lines")
+
+    net = {p: {k: max(v - baseline, 0) for k, v in r.items()}
+           for p, r in results.items()}
+    order = sorted(net, key=lambda p: max(net[p].values()), reverse=True)
+
+    if args.csv:
+        out = csv.writer(sys.stdout)
+        out.writerow(["primitive", "param", "cycles"])
+        for primitive in order:
+            for param in sorted(net[primitive]):
+                out.writerow([primitive, param, net[primitive][param]])
+        return
+
+    print("cycles per call, %d cycles of loop overhead removed" % baseline)
+    for primitive in order:
+        print("%-28s %s" % (primitive, "  ".join(
+            "%d:%d" % (param, net[primitive][param])
+            for param in sorted(net[primitive]))))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""Channel occupancy of a run from the pcapng file of pcap-export.js.
+
+Each frame is on air for its PHY header (preamble, SFD and length, 6
+bytes) and its captured length at 250 kbit/s, from the timestamp of its
+block. The senders are placed on a grid of square regions (--cell, in
+the units of the Cooja positions) and for the whole network and each
+region the tool reports:
+
+- the channel utilisation: the share of the run during which at least
+  one frame of the region was on air, and the offered airtime (the sum
+  over the frames, which exceeds the utilisation when frames overlap);
+- the frame size distribution in 16-byte bins, and the share of
+  broadcast frames (destination address 0xffff);
+- the collision overlap: the share of frames overlapping in time with a
+  frame from a sender within two transmission ranges (--range), which
+  may share a receiver, and the share the radio medium reported as
+  interfered at one of its receivers.
+
+With --sinr the tool also replays every frame through a capture model in
+place of Cooja's radio medium. The received power follows a log-distance
+path loss (--tx-power, --loss-1m, --exponent). For every mote above the
+sensitivity the signal to interference plus noise ratio is tracked over
+the frame, with the power of all frames overlapping it summed as
+interference. The frame is received if the SINR never drops below the
+capture threshold (--capture). It prints, for the network and per mote,
+the receptions that were clean, captured despite an overlapping frame,
+lost to a collision, or lost because the receiver was sending itself.
+Motes are binned on a grid of the sensitivity range and overlapping
+frames are kept in a sweep over time, so runs of 1000 motes take
+seconds.
+
+Usage: pcap-airtime.py [--cell 50] [--range 50] [--sinr [options]]
+                       capture.pcapng
+"""
+
+import argparse
+import collections
+import math
+import re
+import struct
+
+SHB = 0x0A0D0D0A
+IDB = 0x00000001
+EPB = 0x00000006
+
+BYTE_US = 32           # 250 kbit/s
+PHY_HEADER = 6
+SIZE_BIN = 16
+
+
+class Frame:
+    def __init__(self, mote, start, data, comment):
+        self.mote = mote
+        self.start = start
+        self.end = start + (len(data) + PHY_HEADER) * BYTE_US
+        self.size = len(data)
+        self.broadcast = is_broadcast(data)
+        m = re.search(r"interfered (\S+)", comment)
+        self.interfered = m is not None
+        self.overlapping = False
+
+
+def is_broadcast(data):
+    """Whether an 802.15.4 frame is sent to the short address 0xffff"""
+    if len(data) < 7:
+        return False
+    fcf, = struct.unpack_from("<H", data)
+    return (fcf >> 10) & 3 == 2 and data[5:7] == b"\xff\xff"
+
+
+def options(body):
+    """Split the options of a block into a dict of code to value"""
+    result = {}
+    offset = 0
+    while offset + 4 <= len(body):
+        code, length = struct.unpack_from("<HH", body, offset)
+        if code == 0:
+            break
+        result[code] = body[offset + 4:offset + 4 + length]
+        offset += 4 + length + (-length % 4)
+    return result
+
+
+def read(path):
+    """The motes (id, x, y) by interface, and the frames of a capture"""
+    with open(path, "rb") as f:
+        data = f.read()
+    motes = []
+    frames = []
+    offset = 0
+    while offset + 12 <= len(data):
+        kind, length = struct.unpack_from("<II", data, offset)
+        body = data[offset + 8:offset + length - 4]
+        if kind == SHB:
+            if struct.unpack_from("<I", body)[0] != 0x1A2B3C4D:
+                raise SystemExit("%s: not a little-endian pcapng file" % path)
+        elif kind == IDB:
+            opts = options(body[8:])
+            name = opts.get(2, b"").decode()
+            position = [float(v) for v in
+                        re.findall(r"-?[\d.]+", opts.get(3, b"").decode())]
+            motes.append((name.split()[-1] if name else str(len(motes)),
+                          *(position + [0.0, 0.0])[:2]))
+        elif kind == EPB:
+            interface, high, low, captured = struct.unpack_from("<IIII", body)
+            payload = body[20:20 + captured]
+            opts = options(body[20 + captured + (-captured % 4):])
+            frames.append(Frame(interface, (high << 32) | low, payload,
+                                opts.get(1, b"").decode()))
+        offset += length
+    return motes, frames
+
+
+def union(intervals):
+    """Total length of the union of (start, end) intervals"""
+    total = 0
+    last = None
+    for start, end in sorted(intervals):
+        if last is None or start > last:
+            total += end - start
+            last = end
+        elif end > last:
+            total += end - last
+            last = end
+    return total
+
+
+def mark_overlaps(frames, motes, reach):
+    """Flag the frames overlapping a frame from a sender within reach"""
+    frames = sorted(frames, key=lambda f: f.start)
+    active = []
+    for frame in frames:
+        active = [f for f in active if f.end > frame.start]
+        _, x, y = motes[frame.mote]
+        for other in active:
+            _, ox, oy = motes[other.mote]
+            if other.mote != frame.mote and \
+                    math.hypot(x - ox, y - oy) <= reach:
+                frame.overlapping = other.overlapping = True
+        active.append(frame)
+
+
+class Capture:
+    """Log-distance path loss and SINR capture model"""
+
+    def __init__(self, args, motes):
+        self.args = args
+        self.motes = motes
+        self.noise = dbm_to_mw(args.noise)
+        # Distance at which the signal falls to the sensitivity
+        self.reach = 10 ** ((args.tx_power - args.loss_1m - args.sensitivity)
+                            / (10 * args.exponent))
+        self.grid = collections.defaultdict(list)
+        self.powers = {}
+        self.neighbours = {}
+        for index, (_, x, y) in enumerate(motes):
+            self.grid[self.cell(x, y)].append(index)
+        self.counts = collections.Counter()
+        self.per_mote = collections.defaultdict(collections.Counter)
+
+    def cell(self, x, y):
+        return int(x // self.reach), int(y // self.reach)
+
+    def power(self, sender, receiver):
+        """Received power in mW"""
+        key = (sender, receiver)
+        if key not in self.powers:
+            self.powers[key] = self.path(sender, receiver)
+        return self.powers[key]
+
+    def path(self, sender, receiver):
+        _, x, y = self.motes[sender]
+        _, rx, ry = self.motes[receiver]
+        distance = max(math.hypot(x - rx, y - ry), 1.0)
+        return dbm_to_mw(self.args.tx_power - self.args.loss_1m -
+                         10 * self.args.exponent * math.log10(distance))
+
+    def receivers(self, sender):
+        if sender not in self.neighbours:
+            self.neighbours[sender] = list(self.in_range(sender))
+        return self.neighbours[sender]
+
+    def in_range(self, sender):
+        _, x, y = self.motes[sender]
+        cx, cy = self.cell(x, y)
+        floor = dbm_to_mw(self.args.sensitivity)
+        for dx in (-1, 0, 1):
+            for dy in (-1, 0, 1):
+                for receiver in self.grid.get((cx + dx, cy + dy), ()):
+                    if receiver != sender and \
+                            self.power(sender, receiver) >= floor:
+                        yield receiver
+
+    def receive(self, frame, receiver, others):
+        """Outcome of a frame at a receiver given the overlapping frames"""
+        if any(o.mote == receiver for o in others):
+            return "halfduplex"
+        if not others:
+            return "clean"
+        signal = self.power(frame.mote, receiver)
+        threshold = 10 ** (self.args.capture / 10)
+        # The interference is constant between the edges of the others
+        edges = sorted({frame.start, frame.end} |
+                       {t for o in others for t in (o.start, o.end)
+                        if frame.start < t < frame.end})
+        for start, end in zip(edges, edges[1:]):
+            interference = sum(self.power(o.mote, receiver) for o in others
+                               if o.start < end and o.end > start)
+            if signal / (self.noise + interference) < threshold:
+                return "collided"
+        return "captured"
+
+    def run(self, frames):
+        frames = sorted(frames, key=lambda f: f.start)
+        longest = max(f.end - f.start for f in frames)
+        first = 0
+        for frame in frames:
+            # Frames starting before frame.start - longest cannot overlap
+            while frames[first].start < frame.start - longest:
+                first += 1
+            others = []
+            j = first
+            while j < len(frames) and frames[j].start < frame.end:
+                other = frames[j]
+                if other.end > frame.start and other is not frame:
+                    others.append(other)
+                j += 1
+            for receiver in self.receivers(frame.mote):
+                outcome = self.receive(frame, receiver, others)
+                self.counts[outcome] += 1
+                self.per_mote[receiver][outcome] += 1
+
+    def report(self):
+        print("sinr reach %.1f receptions %d clean %d captured %d collided %d "
+              "halfduplex %d" % (
+                  self.reach, sum(self.counts.values()), self.counts["clean"],
+                  self.counts["captured"], self.counts["collided"],
+                  self.counts["halfduplex"]))
+        for index in sorted(self.per_mote):
+            c = self.per_mote[index]
+            print("  mote %s receptions %d clean %d captured %d collided %d "
+                  "halfduplex %d" % (
+                      self.motes[index][0], sum(c.values()), c["clean"],
+                      c["captured"], c["collided"], c["halfduplex"]))
+
+
+def dbm_to_mw(dbm):
+    return 10 ** (dbm / 10)
+
+
+def report(name, frames, duration):
+    if not frames:
+        return
+    airtime = sum(f.end - f.start for f in frames)
+    busy = union((f.start, f.end) for f in frames)
+    sizes = collections.Counter(f.size // SIZE_BIN for f in frames)
+    print("%s: %d frames, utilisation %.2f%%, offered %.2f%%, broadcast "
+          "%.1f%%, overlapping %.1f%%, interfered %.1f%%" % (
+              name, len(frames), 100.0 * busy / duration,
+              100.0 * airtime / duration,
+              100.0 * sum(f.broadcast for f in frames) / len(frames),
+              100.0 * sum(f.overlapping for f in frames) / len(frames),
+              100.0 * sum(f.interfered for f in frames) / len(frames)))
+    print("  sizes: %s" % ", ".join(
+        "%d-%d: %d" % (b * SIZE_BIN, (b + 1) * SIZE_BIN - 1, sizes[b])
+        for b in sorted(sizes)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--cell", type=float, default=50.0,
+                        help="side of the regions")
+    parser.add_argument("--range", type=float, default=50.0,
+                        help="transmission range")
+    parser.add_argument("--sinr", action="store_true",
+                        help="replay the frames through the capture model")
+    parser.add_argument("--tx-power", type=float, default=0.0,
+                        help="transmit power in dBm")
+    parser.add_argument("--loss-1m", type=float, default=40.0,
+                        help="path loss at 1 unit of distance in dB")
+    parser.add_argument("--exponent", type=float, default=3.0,
+                        help="path loss exponent")
+    parser.add_argument("--noise", type=float, default=-100.0,
+                        help="noise floor in dBm")
+    parser.add_argument("--sensitivity", type=float, default=-95.0,
+                        help="receiver sensitivity in dBm")
+    parser.add_argument("--capture", type=float, default=3.0,
+                        help="capture threshold (SINR) in dB")
+    parser.add_argument("capture_file", metavar="capture")
+    args = parser.parse_args()
+
+    motes, frames = read(args.capture_file)
+    if not frames:
+        raise SystemExit("%s: no frames" % args.capture_file)
+    duration = max(f.end for f in frames) - min(f.start for f in frames)
+    mark_overlaps(frames, motes, 2 * args.range)
+
+    print("%d motes, %.3f s captured" % (len(motes), duration / 1e6))
+    report("network", frames, duration)
+
+    regions = collections.defaultdict(list)
+    for frame in frames:
+        _, x, y = motes[frame.mote]
+        regions[(int(x // args.cell), int(y // args.cell))].append(frame)
+    for cell in sorted(regions):
+        report("region %d,%d" % cell, regions[cell], duration)
+
+    if args.sinr:
+        model = Capture(args, motes)
+        model.run(frames)
+        model.report()
+
+
+if __name__ == "__main__":
+    main()
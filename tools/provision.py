@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Generate the provisioning table compiled into the TPWSN firmwares.
+
+Reads a CSV file with one command line per row:
+
+  node,at,command
+  *,0,collect 30
+  1,0,set source
+  5,0,set sink
+  7,120,sleep 60
+
+where node is a Cooja mote ID (node_id) or * for every node, at is the
+time in seconds after boot (0 or empty to run the command at boot) and
+command is any serial command line of the harness or the protocol.
+Several commands can be given in one row, separated by ";". The table
+is written as a C header to include with TPWSN_CONF_PROVISION=1, see
+firmware/common/tpwsn-provision.h, by default to provision-table.h.
+
+Usage: provision.py [-o provision-table.h] table.csv
+"""
+
+import argparse
+import csv
+
+LINE = 64          # TPWSN_PROVISION_LINE
+MAX_AT = 0xffff
+
+
+def rows(path):
+    with open(path, newline="") as f:
+        for number, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            if number == 1 and row[0].strip() == "node":
+                continue
+            if len(row) < 3:
+                raise SystemExit("%s:%d: expected node,at,command" % (
+                    path, number))
+            node = row[0].strip()
+            node = 0 if node == "*" else int(node)
+            at = int(row[1]) if row[1].strip() else 0
+            if not 0 <= at <= MAX_AT:
+                raise SystemExit("%s:%d: time out of range" % (path, number))
+            for command in ",".join(row[2:]).split(";"):
+                command = " ".join(command.split())
+                if len(command) >= LINE:
+                    raise SystemExit("%s:%d: command longer than %d "
+                                     "characters" % (path, number, LINE - 1))
+                if command:
+                    yield node, at, command
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("-o", "--output", default="provision-table.h")
+    parser.add_argument("table")
+    args = parser.parse_args()
+
+    # Stable, so the commands of a node keep their order
+    entries = sorted(rows(args.table), key=lambda e: e[1])
+    with open(args.output, "w") as out:
+        out.write("/* Generated by tools/provision.py from %s */\n\n"
+                  % args.table)
+        out.write("static const struct tpwsn_provision provision_table[] "
+                  "= {\n")
+        for node, at, command in entries:
+            out.write('  { %d, %d, "%s" },\n' % (
+                node, at, command.replace("\\", "\\\\").replace('"', '\\"')))
+        if not entries:
+            out.write("  { TPWSN_PROVISION_ALL, 0, NULL },\n")
+        out.write("};\n")
+    print("%d entries written to %s" % (len(entries), args.output))
+
+
+if __name__ == "__main__":
+    main()
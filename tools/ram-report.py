@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Break down the static RAM of a firmware image by source module.
+
+Symbols in the writable sections (.data, .bss, .noinit) are attributed to
+the source file that defines them. The tool uses the stabs debug
+information of old mspgcc builds when it is present. Otherwise it uses
+the DWARF line information that current msp430-gcc emits by default, read
+with "nm -l" (msp430-elf-nm, msp430-nm or nm, the first one found). Without
+either, only static symbols can be attributed, through the FILE entries
+of the symbol table. Global symbols then show as "(global)" and a warning
+is printed.
+
+Usage: ram-report.py firmware.sky
+"""
+
+import collections
+import os
+import shutil
+import struct
+import subprocess
+import sys
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+STB_LOCAL = 0
+STT_OBJECT = 1
+STT_FILE = 4
+
+N_UNDF = 0x00
+N_GSYM = 0x20
+N_STSYM = 0x26
+N_LCSYM = 0x28
+N_SO = 0x64
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise SystemExit("%s: not a 32-bit ELF file" % path)
+        self.endian = "<" if self.data[5] == 1 else ">"
+        shoff, = struct.unpack_from(self.endian + "I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(
+            self.endian + "HHH", self.data, 0x2E)
+        self.sections = [struct.unpack_from(self.endian + "IIIIIIIIII",
+                                            self.data, shoff + i * shentsize)
+                         for i in range(shnum)]
+        strtab = self.sections[shstrndx][4]
+        self.names = [self.string(strtab + s[0]) for s in self.sections]
+
+    def string(self, offset):
+        return self.data[offset:self.data.index(b"\0", offset)].decode()
+
+    def section(self, name):
+        for i, section_name in enumerate(self.names):
+            if section_name == name:
+                return self.sections[i]
+        return None
+
+    def symbols(self):
+        symtab = self.section(".symtab")
+        strtab = self.sections[symtab[6]][4]
+        for offset in range(symtab[4], symtab[4] + symtab[5], symtab[9]):
+            name, value, size, info, _, shndx = struct.unpack_from(
+                self.endian + "IIIBBH", self.data, offset)
+            yield (self.string(strtab + name), value, size, info >> 4,
+                   info & 0xF, shndx)
+
+    def stabs(self):
+        """Yield (type, name, value, source file) for every stab."""
+        stab = self.section(".stab")
+        stabstr = self.section(".stabstr")
+        if stab is None or stabstr is None:
+            return
+        base = next_base = stabstr[4]
+        source = None
+        for offset in range(stab[4], stab[4] + stab[5], 12):
+            strx, n_type, _, _, value = struct.unpack_from(
+                self.endian + "IBBHI", self.data, offset)
+            if n_type == N_UNDF:
+                base = next_base
+                next_base = base + value
+                continue
+            name = self.string(base + strx) if strx else ""
+            if n_type == N_SO and name and not name.endswith("/"):
+                source = os.path.basename(name)
+            yield n_type, name.split(":")[0], value, source
+
+
+def nm_modules(path):
+    """(globals by name, statics by address) from the DWARF line info"""
+    globals_, statics = {}, {}
+    for tool in ("msp430-elf-nm", "msp430-nm", "nm"):
+        if shutil.which(tool) is not None:
+            break
+    else:
+        return globals_, statics
+    result = subprocess.run([tool, "-l", "--defined-only", path],
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            universal_newlines=True)
+    for line in result.stdout.splitlines():
+        symbol, _, location = line.partition("\t")
+        fields = symbol.split()
+        if len(fields) != 3 or not location:
+            continue
+        value, kind, name = fields
+        source = os.path.basename(location.rsplit(":", 1)[0])
+        if kind.isupper():
+            globals_[name] = source
+        else:
+            statics[int(value, 16)] = source
+    return globals_, statics
+
+
+def main():
+    if len(sys.argv) != 2:
+        raise SystemExit(__doc__)
+    elf = Elf(sys.argv[1])
+
+    ram = {i for i, s in enumerate(elf.sections)
+           if s[2] & SHF_ALLOC and s[2] & SHF_WRITE}
+
+    # Module of each global by name and of each static by address
+    globals_, statics = {}, {}
+    for n_type, name, value, source in elf.stabs():
+        if n_type == N_GSYM:
+            globals_[name] = source
+        elif n_type in (N_STSYM, N_LCSYM):
+            statics[value] = source
+    if not globals_ and not statics:
+        globals_, statics = nm_modules(sys.argv[1])
+    if not globals_ and not statics:
+        print("warning: no stabs or DWARF line information, global symbols "
+              "are not attributed (build with -g)", file=sys.stderr)
+
+    usage = collections.defaultdict(lambda: [0, 0])
+    symbols = {}
+    module = None
+    for name, value, size, bind, sym_type, shndx in elf.symbols():
+        symbols[name] = value
+        if sym_type == STT_FILE:
+            module = name
+            continue
+        if sym_type != STT_OBJECT or shndx not in ram or size == 0:
+            continue
+        if bind == STB_LOCAL:
+            owner = statics.get(value) or module
+        else:
+            owner = globals_.get(name) or "(global)"
+        bss = elf.sections[shndx][1] == SHT_NOBITS
+        usage[owner][bss] += size
+    print("%-32s %8s %8s %8s" % ("module", "data", "bss", "total"))
+    total_data = total_bss = 0
+    for owner, (data, bss) in sorted(usage.items(),
+                                     key=lambda item: -sum(item[1])):
+        print("%-32s %8d %8d %8d" % (owner, data, bss, data + bss))
+        total_data += data
+        total_bss += bss
+    print("%-32s %8d %8d %8d" % ("total", total_data, total_bss,
+                                 total_data + total_bss))
+
+    # Space left for the heap and the stack on mspgcc builds
+    if "__stack" in symbols and "_end" in symbols:
+        print("free for heap and stack: %d bytes"
+              % (symbols["__stack"] - symbols["_end"]))
+
+
+if __name__ == "__main__":
+    main()
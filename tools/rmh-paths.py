@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Summarise the paths recorded by the RMH firmware ("path on").
+
+Reads the "path <sink> from <originator> entries <n> overflow <0|1>:
+<id>@<time> ..." lines printed by the sinks (decoded with tlog-decode.py
+first if the log holds tokenised records) and reports, over all packets,
+the path length, how many paths revisit a node and by how much, how
+often each node relays, and the per-hop latency.
+
+The timestamps are the low 16 bits of each node's own clock_time(), so
+per-hop latencies are only meaningful when the node clocks agree, as
+they do in a Cooja simulation where all motes boot together.
+
+Usage: rmh-paths.py [log]
+"""
+
+import collections
+import re
+import statistics
+import sys
+
+PATH_RE = re.compile(r"path (\d+\.\d+) from (\d+\.\d+) entries (\d+) "
+                     r"overflow ([01]):((?: \d+@\d+)*)")
+
+
+def parse(lines):
+    for line in lines:
+        m = PATH_RE.search(line)
+        if m is None:
+            continue
+        hops = [tuple(int(v) for v in e.split("@"))
+                for e in m.group(5).split()]
+        yield m.group(1), m.group(2), m.group(4) == "1", hops
+
+
+def describe(name, values, unit=""):
+    if not values:
+        print("%s: none" % name)
+        return
+    print("%s: mean %.2f%s median %s min %s max %s" % (
+        name, statistics.mean(values), unit, statistics.median(values),
+        min(values), max(values)))
+
+
+def main():
+    stream = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    lengths = []
+    revisits = []
+    latencies = []
+    relays = collections.Counter()
+    overflows = 0
+    packets = 0
+
+    for sink, originator, overflow, hops in parse(stream):
+        packets += 1
+        overflows += overflow
+        ids = [node for node, _ in hops]
+        lengths.append(len(ids) - 1)
+        revisits.append(len(ids) - len(set(ids)))
+        relays.update(ids[1:-1])
+        for (_, t0), (_, t1) in zip(hops, hops[1:]):
+            latencies.append((t1 - t0) & 0xffff)
+
+    print("packets: %d (%d overflowed the record)" % (packets, overflows))
+    if packets == 0:
+        return
+    describe("hops", lengths)
+    looped = sum(1 for r in revisits if r > 0)
+    print("paths revisiting a node: %d (%.1f%%)" % (
+        looped, 100.0 * looped / packets))
+    describe("revisits per path", revisits)
+    describe("per-hop latency", latencies, " ticks")
+    print("busiest relays: %s" % ", ".join(
+        "%d (%d)" % item for item in relays.most_common(10)))
+
+
+if __name__ == "__main__":
+    main()
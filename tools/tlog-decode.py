@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Re-render tokenised log records written by firmware/common/tlog.c.
+
+The format strings are read from the .tlog section of the unstripped
+firmware ELF file. The log is read from a file or stdin. Text before a
+record on its line (such as the Cooja time and mote ID) is kept, and
+lines that are not tokenised records are copied through unchanged.
+
+Usage: tlog-decode.py firmware.sky [log]
+"""
+
+import re
+import struct
+import sys
+
+TLOG_MARKER = b"tlog:"
+
+# Argument type tags, see tlog.h
+TLOG_ARG_INT = 1
+TLOG_ARG_LONG = 2
+TLOG_ARG_STR = 3
+
+CONVERSION = re.compile(rb"%[-+ #0]*\d*(?:\.\d+)?(l?)([diouxXcs%])")
+
+
+def read_formats(path):
+    """Map the low 16 bits of each format string address to the string."""
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF":
+        raise SystemExit("%s: not an ELF file" % path)
+    endian = "<" if elf[5] == 1 else ">"
+    if elf[4] == 1:
+        shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x2E)
+        header = endian + "IIIIII"
+    else:
+        shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", elf, 0x3A)
+        header = endian + "IIQQQQ"
+
+    # (name, type, flags, addr, offset, size) of every section
+    sections = [struct.unpack_from(header, elf, shoff + i * shentsize)
+                for i in range(shnum)]
+    names = sections[shstrndx]
+    formats = {}
+    for name, _, _, addr, offset, size in sections:
+        start = names[4] + name
+        if elf[start:elf.index(b"\0", start)] != b".tlog":
+            continue
+        data = elf[offset:offset + size]
+        pos = 0
+        while pos < len(data):
+            end = data.index(b"\0", pos)
+            formats[(addr + pos) & 0xFFFF] = data[pos:end]
+            # Format strings are aligned to the section's alignment
+            pos = end + 1
+            while pos < len(data) and data[pos] == 0:
+                pos += 1
+    return formats
+
+
+def read_args(record):
+    """Split the type-tagged argument buffer into values."""
+    args = []
+    pos = 0
+    while pos < len(record):
+        tag = record[pos]
+        pos += 1
+        if tag == TLOG_ARG_STR:
+            end = record.find(b"\0", pos)
+            if end < 0:
+                break
+            args.append(record[pos:end])
+            pos = end + 1
+        elif tag in (TLOG_ARG_INT, TLOG_ARG_LONG):
+            size = 2 if tag == TLOG_ARG_INT else 4
+            if pos + size > len(record):
+                break
+            args.append((tag, record[pos:pos + size]))
+            pos += size
+        else:
+            break
+    return args
+
+
+def render(formats, record):
+    try:
+        record = bytes.fromhex(record.decode("ascii"))
+    except ValueError:
+        return b"<malformed tlog record>\n"
+    if len(record) < 2:
+        return b"<malformed tlog record>\n"
+    token, = struct.unpack_from("<H", record, 0)
+    fmt = formats.get(token)
+    if fmt is None:
+        return b"<unknown tlog token 0x%04x>\n" % token
+    values = read_args(record[2:])
+    args = []
+    end = len(fmt)
+    for match in CONVERSION.finditer(fmt):
+        conv = match.group(2)
+        if conv == b"%":
+            continue
+        if len(args) == len(values):
+            # The firmware dropped the rest of the arguments
+            end = match.start()
+            break
+        value = values[len(args)]
+        if isinstance(value, tuple):
+            raw = value[1]
+            signed = conv in b"di"
+            value = int.from_bytes(raw, "little", signed=signed)
+        args.append(value)
+    python_fmt = CONVERSION.sub(lambda m: m.group(0).replace(b"l", b""),
+                                fmt[:end])
+    text = python_fmt % tuple(args)
+    if end < len(fmt):
+        text += b"<truncated>\n"
+    return text
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        raise SystemExit(__doc__)
+    formats = read_formats(sys.argv[1])
+    log = open(sys.argv[2], "rb") if len(sys.argv) == 3 else sys.stdin.buffer
+    out = sys.stdout.buffer
+    for line in log:
+        start = line.find(TLOG_MARKER)
+        if start < 0:
+            out.write(line)
+            continue
+        out.write(line[:start])
+        out.write(render(formats, line[start + len(TLOG_MARKER):].strip()))
+    out.flush()
+
+
+if __name__ == "__main__":
+    main()
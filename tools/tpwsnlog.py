@@ -0,0 +1,276 @@
+"""Shared parsing of TPWSN firmware logs for the analysis tools.
+
+A log is the serial output of every mote of a run, one line per message,
+as saved by Cooja's log listener ("<time>\tID:<n>\t<message>") or any
+capture where each message keeps its "<addr>: " prefix. Nodes are named
+"<id & 0xff>.<id >> 8>" after their Cooja mote ID where the log has one,
+as the address prefix does not tell the nodes apart on every stack (the
+Contiki-NG log lines of the Trickle firmware have none). Tokenised
+records have to be decoded with tlog-decode.py first.
+
+The counters printed by the "stats" command are cumulative, so only the
+last line of each kind per node is kept.
+"""
+
+import json
+import re
+
+# "<addr>: <kind> <key> <value> <key> <value> ..." lines printed by stats,
+# or "[<level>: <module>] <kind> ..." from the Contiki-NG log module
+STATS_RE = re.compile(r"(?:(\d+\.\d+): |\] )(stats|energest|energy uJ|mac|mem|"
+                      r"wur|eno|rmh|trickle(?: updates| leaf)?) (.*)")
+NUMBER_RE = re.compile(r"-?\d+")
+
+# Cooja's log listener prefixes each line with the time in ms or mm:ss.mmm
+TIME_RE = re.compile(r"^(?:(\d+):)?(\d+)(?:\.(\d+))?\s")
+
+# Current draw of the Tmote Sky, as in firmware/common/tpwsn-energy.h.
+# Currents in mA, voltage in V, Energest time in ticks per second.
+DEFAULT_TABLE = {
+    "voltage": 3.0,
+    "ticks_per_second": 32768,
+    "cpu": 1.8,
+    "lpm": 0.055,
+    "rx": 18.8,
+    "tx_level": 31,
+    "tx": {"3": 8.5, "7": 9.9, "11": 11.2, "15": 12.5,
+           "19": 13.9, "23": 15.2, "27": 16.5, "31": 17.4},
+    "flash_write": 15.0,
+    "flash_read": 4.0,
+}
+
+STATES = ("cpu", "lpm", "tx", "rx")
+
+
+def load_table(path=None):
+    """The default current-draw table, updated from a JSON file"""
+    table = dict(DEFAULT_TABLE)
+    if path is not None:
+        with open(path) as f:
+            table.update(json.load(f))
+    return table
+
+
+def tx_current(table, level=None):
+    """Transmit current in mA at a PA level, rounded up to a table entry"""
+    level = table["tx_level"] if level is None else level
+    points = sorted((int(k), v) for k, v in table["tx"].items())
+    for point, current in points:
+        if level <= point:
+            return current
+    return points[-1][1]
+
+
+def energy(table, energest):
+    """Joules spent in each state for an Energest line's tick counts"""
+    currents = {"cpu": table["cpu"], "lpm": table["lpm"],
+                "tx": tx_current(table), "rx": table["rx"]}
+    return {state: energest.get(state, 0) / table["ticks_per_second"] *
+            currents[state] / 1000.0 * table["voltage"]
+            for state in STATES}
+
+
+def fields(text):
+    """Split "key value key value" into a dict, numbers as ints"""
+    tokens = text.split()
+    result = {}
+    for key, value in zip(tokens, tokens[1:]):
+        if NUMBER_RE.fullmatch(value) and not NUMBER_RE.fullmatch(key):
+            result[key] = int(value)
+    return result
+
+
+def parse_stats(lines):
+    """Map each node to {kind: fields} from the last stats lines"""
+    nodes = {}
+    for line in lines:
+        m = STATS_RE.search(line)
+        if m is None:
+            continue
+        node = node_of(line, m.group(1))
+        if node is not None:
+            nodes.setdefault(node, {})[m.group(2)] = fields(m.group(3))
+    return nodes
+
+
+def line_time(line):
+    """The Cooja timestamp of a line in seconds, None if it has none"""
+    m = TIME_RE.match(line)
+    if m is None:
+        return None
+    minutes, seconds, fraction = m.groups()
+    if minutes is None and fraction is None:
+        return int(seconds) / 1000.0
+    value = int(seconds) + float("0." + fraction) if fraction else int(seconds)
+    return value + 60 * int(minutes or 0)
+
+
+# Cooja's log listener names the mote of each line "ID:<n>"
+MOTE_RE = re.compile(r"\bID:(\d+)")
+
+
+def node_name(mote):
+    """The node name of a Cooja mote ID, as the firmware prints it"""
+    return "%d.%d" % (mote & 0xFF, mote >> 8)
+
+
+def node_of(line, prefix=None):
+    """The node of a line: its Cooja mote ID if it has one, otherwise the
+    address prefix, None if neither"""
+    m = MOTE_RE.search(line)
+    if m is not None:
+        return node_name(int(m.group(1)))
+    return prefix
+
+
+def mote_ids(lines):
+    """Map each node to its Cooja mote ID where the log has one"""
+    ids = {}
+    for line in lines:
+        m = MOTE_RE.search(line)
+        if m is not None:
+            ids[node_name(int(m.group(1)))] = int(m.group(1))
+    return ids
+
+
+def read_positions(path):
+    """Mote positions {id: (x, y)} from a Cooja .csc simulation file"""
+    import xml.etree.ElementTree as ET
+
+    positions = {}
+    for mote in ET.parse(path).getroot().iter("mote"):
+        x = y = ident = None
+        for config in mote.iter("interface_config"):
+            if config.find("x") is not None:
+                x = float(config.find("x").text)
+                y = float(config.find("y").text)
+            if config.find("id") is not None:
+                ident = int(config.find("id").text)
+        if ident is not None and x is not None:
+            positions[ident] = (x, y)
+    return positions
+
+
+# Events used to time a dissemination
+GENERATE_RE = re.compile(r"Generating a new token 0x([0-9a-f]+)")
+TOKEN_RE = re.compile(r"Our token=0x([0-9a-f]+), theirs=0x([0-9a-f]+)")
+BUTTON_RE = re.compile(r"Button pressed, starting RMH bcast")
+DELIVER_RE = re.compile(r"sink \d+\.\d+ received '.*' from (\d+\.\d+) "
+                        r"at \d+, hops (\d+)")
+
+# Metrics for which a smaller value is an improvement
+LOWER_IS_BETTER = {"energy_mj", "tx", "collisions", "busy", "latency_s",
+                   "hops", "utilisation_pct", "overlapping_pct",
+                   "interfered_pct", "sinr_collided_pct"}
+
+# Network and capture model lines printed by pcap-airtime.py
+AIRTIME_RE = re.compile(r"^network: \d+ frames, utilisation ([\d.]+)%, .*"
+                        r"overlapping ([\d.]+)%, interfered ([\d.]+)%")
+SINR_RE = re.compile(r"^sinr reach \S+ receptions (\d+) clean \d+ "
+                     r"captured \d+ collided (\d+)")
+
+
+def airtime_metrics(lines):
+    """The channel metrics of the output of pcap-airtime.py --sinr"""
+    metrics = {}
+    for line in lines:
+        m = AIRTIME_RE.match(line)
+        if m is not None:
+            metrics["utilisation_pct"] = float(m.group(1))
+            metrics["overlapping_pct"] = float(m.group(2))
+            metrics["interfered_pct"] = float(m.group(3))
+        m = SINR_RE.match(line)
+        if m is not None and int(m.group(1)) > 0:
+            metrics["sinr_collided_pct"] = \
+                100.0 * int(m.group(2)) / int(m.group(1))
+    return metrics
+
+
+def mote_of(line):
+    m = MOTE_RE.search(line)
+    return int(m.group(1)) if m is not None else None
+
+
+def trickle_latency(lines):
+    """Mean time from a new token at the source until the last node that
+    ever holds it has it, in seconds"""
+    generated = {}
+    holds = {}
+    for line in lines:
+        time = line_time(line)
+        if time is None:
+            continue
+        m = GENERATE_RE.search(line)
+        if m is not None:
+            generated.setdefault(int(m.group(1), 16), time)
+            holds.setdefault(int(m.group(1), 16), {})[mote_of(line)] = time
+            continue
+        m = TOKEN_RE.search(line)
+        if m is not None:
+            newest = max(int(m.group(1), 16), int(m.group(2), 16))
+            for token, start in generated.items():
+                if token <= newest:
+                    holds[token].setdefault(mote_of(line), time)
+    latencies = [max(holds[t].values()) - generated[t] for t in generated]
+    return sum(latencies) / len(latencies) if latencies else None
+
+
+def rmh_latency(lines):
+    """Mean and hops of the deliveries, matched to the last button press
+    of their originator, in seconds"""
+    ids = mote_ids(lines)
+    pressed = {}
+    latencies = []
+    hops = []
+    for line in lines:
+        time = line_time(line)
+        if BUTTON_RE.search(line) and time is not None:
+            pressed[mote_of(line)] = time
+            continue
+        m = DELIVER_RE.search(line)
+        if m is not None:
+            hops.append(int(m.group(2)))
+            start = pressed.get(ids.get(m.group(1)))
+            if start is not None and time is not None:
+                latencies.append(time - start)
+    return (sum(latencies) / len(latencies) if latencies else None,
+            sum(hops) / len(hops) if hops else None)
+
+
+def run_metrics(lines, table=None, airtime=None):
+    """The metrics of a run compared between firmware revisions, with
+    those of its capture if the output of pcap-airtime.py is given"""
+    lines = list(lines)
+    table = table or load_table()
+    nodes = parse_stats(lines)
+    metrics = {}
+
+    energest = [n["energest"] for n in nodes.values() if "energest" in n]
+    if energest:
+        metrics["energy_mj"] = 1000 * sum(
+            sum(energy(table, e).values()) for e in energest)
+    harness = [n["stats"] for n in nodes.values() if "stats" in n]
+    if harness:
+        metrics["tx"] = sum(s.get("tx", 0) for s in harness)
+        newest = max(s.get("coverage", 0) for s in harness)
+        metrics["coverage"] = sum(1 for s in harness
+                                  if s.get("coverage", 0) == newest and
+                                  newest > 0) / len(harness)
+    mac = [n["mac"] for n in nodes.values() if "mac" in n]
+    if mac:
+        metrics["collisions"] = sum(m.get("collision", 0) for m in mac)
+        metrics["busy"] = sum(m.get("busy", 0) for m in mac)
+
+    if any("rmh" in n for n in nodes.values()):
+        metrics["delivered"] = sum(n["rmh"].get("delivered", 0)
+                                   for n in nodes.values() if "rmh" in n)
+        latency, hops = rmh_latency(lines)
+        if hops is not None:
+            metrics["hops"] = hops
+    else:
+        latency = trickle_latency(lines)
+    if latency is not None:
+        metrics["latency_s"] = latency
+    if airtime is not None:
+        metrics.update(airtime_metrics(airtime))
+    return metrics